@@ -24,6 +24,7 @@
 
 #include<iostream>
 #include<vector>
+#include<algorithm>
 
 #include <sdsl/suffix_trees.hpp>
 
@@ -89,9 +90,11 @@ void generate_samples(size_t Max_Sampling_Size, size_t seed, samples_t& samples,
                     len = (rand() % l);
                 }
 
-                uint8_t c = ra->charAt(pos);
-                samples[q][i].push_back(c);
-                len--; pos++;
+                size_t k = std::min({len, l - samples[q][i].size(), n - pos});
+                size_t size = samples[q][i].size();
+                samples[q][i].resize(size + k);
+                ra->extract(pos, k, samples[q][i].data() + size);
+                len -= k; pos += k;
             }
             
         }
@@ -137,6 +140,30 @@ auto BM_MS =
         _samples[q].size(), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
 };
 
+// Benchmark random access to the text, _length characters from each position
+auto BM_Access =
+[](benchmark::State &_state, auto _ra, const auto &_positions, const size_t _length ) {
+    std::vector<uint8_t> buffer(_length);
+    for (auto _ : _state)
+    {
+        for (auto pos : _positions)
+        {
+            if (_length == 1)
+                benchmark::DoNotOptimize(_ra->charAt(pos));
+            else
+            {
+                _ra->extract(pos, _length, buffer.data());
+                benchmark::DoNotOptimize(buffer.data());
+            }
+        }
+    }
+
+    _state.counters["Length"] = _length;
+    _state.counters["Size_b_p(bytes)"] = sdsl::size_in_bytes(_ra->b_p) + sdsl::size_in_bytes(_ra->rank_b_p) + sdsl::size_in_bytes(_ra->select_b_p);
+    _state.counters["Accesses"] = _positions.size();
+    _state.counters["Time_x_Access"] = benchmark::Counter(
+        _positions.size(), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+};
 
 int main(int argc, char *argv[])
 {
@@ -184,6 +211,7 @@ int main(int argc, char *argv[])
     std::cout << "ALERT!!! w is hardcoded to be 10!"<< std::endl;
     size_t w = 10;
     pfp_ra ra(test_file, w);
+    pfp_ra_bv ra_bv(test_file, w);
 
 
 
@@ -233,6 +261,19 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Random access with the phrase boundaries in Elias-Fano and in a plain bitvector
+    std::vector<size_t> positions(Max_Sampling_Size);
+    for (auto &pos : positions)
+        pos = rand() % ra.n;
+
+    for (size_t length : {1, 64})
+    {
+        auto bm_name = "ra-sd-access-" + std::to_string(length);
+        benchmark::RegisterBenchmark(bm_name.c_str(), BM_Access, &ra, positions, length);
+        bm_name = "ra-bv-access-" + std::to_string(length);
+        benchmark::RegisterBenchmark(bm_name.c_str(), BM_Access, &ra_bv, positions, length);
+    }
+
     benchmark::Initialize(&argc, argv);
     benchmark::RunSpecifiedBenchmarks();
 
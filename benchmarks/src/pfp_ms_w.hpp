@@ -55,8 +55,7 @@ public :
     for (size_t i = 0; i < pointers.size(); ++i)
     {
       size_t pos = pointers[i];
-      while ((i + l) < pattern.size() && (pos + l) < ra->n && pattern[i + l] == ra->charAt(pos + l))
-        ++l;
+      l += ra->match_length(pos + l, pattern.data() + i + l, pattern.size() - (i + l));
 
       lengths[i] = l;
       l = (l == 0 ? 0 : (l - 1));
@@ -27,6 +27,7 @@
 #include <iostream>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>      // memcpy
 #include <ctime>
 #include <assert.h>
 
@@ -38,12 +39,18 @@
  #include <fcntl.h>
 
 #include <sstream>      // std::stringstream
+#include <fstream>      // std::ofstream
 
 #include <vector>      // std::vector
 
 #include <chrono>       // high_resolution_clock
 
 #include <sdsl/io.hpp>  // serialize and load
+#include <sdsl/bits.hpp> // read_int
+#include <sdsl/int_vector.hpp>
+#include <memory>       // shared_ptr
+#include <thread>       // std::thread
+#include <algorithm>    // sort and inplace_merge
 #include <type_traits>  // enable_if_t and is_fundamental
 
 //**************************** From  Big-BWT ***********************************
@@ -269,6 +276,770 @@ void write_file(const char *filename, std::vector<T> &ptr)
   fclose(fd);
 }
 
+// Returns true if the file a exists and has been modified after the file b.
+// The times are compared to the nanosecond, and two files modified within the
+// resolution of the file system are not considered one newer than the other.
+bool is_newer(std::string a, std::string b)
+{
+  struct stat stat_a, stat_b;
+  if (stat(a.c_str(), &stat_a) < 0)
+    return false;
+  if (stat(b.c_str(), &stat_b) < 0)
+    return true;
+  if (stat_a.st_mtim.tv_sec != stat_b.st_mtim.tv_sec)
+    return stat_a.st_mtim.tv_sec > stat_b.st_mtim.tv_sec;
+  return stat_a.st_mtim.tv_nsec > stat_b.st_mtim.tv_nsec;
+}
+
+// Writes filename with write(out) to a temporary file, that replaces it only when
+// complete and on disk, so that a run stopped in the middle never leaves a truncated
+// file newer than its inputs.
+template <typename F>
+void write_file_atomically(std::string filename, F write)
+{
+  std::string tmp_filename = filename + std::string(".tmp");
+  {
+    std::ofstream out(tmp_filename, std::ios::binary);
+    if (!out)
+      error("open() file " + tmp_filename + " failed");
+    write(out);
+    out.close();
+    if (!out)
+      error("write() file " + tmp_filename + " failed");
+  }
+
+  int fd = open(tmp_filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    error("open() file " + tmp_filename + " failed");
+  if (fsync(fd) < 0)
+    error("fsync() file " + tmp_filename + " failed");
+  close(fd);
+
+  if (rename(tmp_filename.c_str(), filename.c_str()) < 0)
+    error("rename() file " + tmp_filename + " failed");
+}
+
+// Read-only memory mapping of a whole file, unmapped on destruction.
+class mapped_file
+{
+public:
+  mapped_file(std::string filename, bool sequential = false)
+  {
+    struct stat filestat;
+
+    if ((fd = open(filename.c_str(), O_RDONLY)) < 0)
+      error("open() file " + filename + " failed");
+
+    if (fstat(fd, &filestat) < 0)
+      error("stat() file " + filename + " failed");
+
+    length = filestat.st_size;
+
+    // Empty files cannot be mapped
+    if (length == 0)
+      return;
+
+    if ((ptr = (char *)mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+      error("mmap() file " + filename + " failed");
+
+    if (sequential)
+      madvise(ptr, length, MADV_SEQUENTIAL);
+  }
+
+  ~mapped_file()
+  {
+    if (ptr != nullptr)
+      munmap(ptr, length);
+    close(fd);
+  }
+
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+
+  inline const char *data() const { return ptr; }
+  inline size_t size() const { return length; }
+
+  // Tells the kernel how the mapping will be read, e.g. MADV_RANDOM to avoid
+  // reading ahead pages that are not going to be used.
+  inline void advise(int advice) const
+  {
+    if (ptr != nullptr)
+      madvise(ptr, length, advice);
+  }
+
+private:
+  int fd;
+  char *ptr = nullptr;
+  size_t length;
+};
+
+// Decodes a file of little-endian integers of bytes bytes each (e.g. the
+// 5-byte .thr_pos, .ssa and .esa files), calling f(i, value) for the i-th one.
+// The file is mapped and each value is unpacked with one unaligned 8-byte load
+// and a mask; only the last values, whose load would cross the end of the
+// file, are copied byte by byte.
+// Returns the number of values.
+template <typename F>
+size_t read_packed_file(std::string filename, size_t bytes, F f)
+{
+  assert(bytes > 0 and bytes <= 8);
+
+  mapped_file file(filename, true);
+
+  if (file.size() % bytes != 0)
+    error("invilid file " + filename);
+
+  const size_t n = file.size() / bytes;
+  const char *p = file.data();
+  const uint64_t mask = (bytes == 8 ? ~0ULL : (1ULL << (8 * bytes)) - 1);
+
+  // Number of values that can be read with an 8-byte load
+  const size_t n_fast = (file.size() >= 8 ? (file.size() - 8) / bytes + 1 : 0);
+
+  size_t i = 0;
+  for (; i < n_fast; ++i, p += bytes)
+  {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    f(i, value & mask);
+  }
+  for (; i < n; ++i, p += bytes)
+  {
+    uint64_t value = 0;
+    memcpy(&value, p, bytes);
+    f(i, value);
+  }
+
+  return n;
+}
+
+// Input stream buffer over a memory region, e.g. a section of a mapped file.
+class memory_streambuf : public std::streambuf
+{
+public:
+  memory_streambuf(const char *begin, size_t length)
+  {
+    char *p = const_cast<char *>(begin);
+    setg(p, p, p + length);
+  }
+};
+
+// Read-only view of a bit-packed integer array stored in an external buffer.
+// The layout is the one of sdsl::int_vector<>, so the view can be used both
+// on the data of an int_vector<> and on a section of a mapped file.
+class packed_view
+{
+public:
+  packed_view() {}
+
+  packed_view(const uint64_t *data_, size_t size_, uint8_t width_) : data(data_),
+                                                                     n(size_),
+                                                                     w(width_)
+  {
+  }
+
+  inline uint64_t operator[](size_t i) const
+  {
+    if (w == 64)
+      return data[i];
+    size_t bit = i * w;
+    return sdsl::bits::read_int(data + (bit >> 6), bit & 0x3F, w);
+  }
+
+  inline const uint64_t *words() const { return data; }
+  inline size_t size() const { return n; }
+  inline uint8_t width() const { return w; }
+  // Number of bytes of the packed representation, rounded up to a whole word
+  inline size_t bytes() const { return ((n * w + 63) >> 6) * sizeof(uint64_t); }
+
+private:
+  const uint64_t *data = nullptr;
+  size_t n = 0;
+  uint8_t w = 64;
+};
+
+// Range minimum queries returning the minimum value of a bit-packed vector.
+// The vector is split in blocks of 64 entries grouped in superblocks of 8 blocks.
+// A query scans at most two partial blocks and the block minima of two partial
+// superblocks, and takes the rest from a sparse table over the superblock minima.
+class block_rmq
+{
+public:
+  typedef size_t size_type;
+
+  block_rmq() {}
+
+  block_rmq(const sdsl::int_vector<> *v_)
+  {
+    set_vector(v_);
+    build();
+  }
+
+  block_rmq(const packed_view &v_) : v(v_)
+  {
+    build();
+  }
+
+  // The views of the copy refer to its own tables
+  block_rmq(const block_rmq &other) : v(other.v), block_min(other.block_min), table(other.table)
+  {
+    set_views();
+  }
+
+  block_rmq &operator=(const block_rmq &other)
+  {
+    v = other.v;
+    block_min = other.block_min;
+    table = other.table;
+    set_views();
+    return *this;
+  }
+
+  // Minimum of v[l..r], with l <= r
+  inline uint64_t operator()(size_t l, size_t r) const
+  {
+    assert(l <= r && r < v.size());
+    const size_t bl = l >> block_bits;
+    const size_t br = r >> block_bits;
+    if (bl == br)
+      return scan(v, l, r);
+
+    uint64_t res = std::min(scan(v, l, ((bl + 1) << block_bits) - 1), scan(v, br << block_bits, r));
+    if (bl + 1 < br)
+      res = std::min(res, query_blocks(bl + 1, br - 1));
+    return res;
+  }
+
+  void set_vector(const sdsl::int_vector<> *v_)
+  {
+    v = packed_view(v_->data(), v_->size(), v_->width());
+  }
+
+  size_type serialize(std::ostream &out, sdsl::structure_tree_node *v_ = nullptr, std::string name = "") const
+  {
+    sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(v_, name, sdsl::util::class_name(*this));
+    size_type written_bytes = 0;
+
+    written_bytes += block_min.serialize(out, child, "block_min");
+    written_bytes += sdsl::write_member(table.size(), out, child, "levels");
+    for (auto &level : table)
+      written_bytes += level.serialize(out, child, "table");
+
+    sdsl::structure_tree::add_size(child, written_bytes);
+    return written_bytes;
+  }
+
+  void load(std::istream &in, const sdsl::int_vector<> *v_)
+  {
+    set_vector(v_);
+    load_tables(in);
+  }
+
+  void load(std::istream &in, const packed_view &v_)
+  {
+    v = v_;
+    load_tables(in);
+  }
+
+private:
+  static const size_t block_bits = 6;      // 64 entries per block
+  static const size_t superblock_bits = 3; // 8 blocks per superblock
+
+  packed_view v;
+  sdsl::int_vector<> block_min;
+  std::vector<sdsl::int_vector<>> table; // table[k][i] is the minimum of superblocks [i, i + 2^k)
+
+  packed_view block_min_view;
+  std::vector<packed_view> table_view;
+
+  static inline uint64_t scan(const packed_view &a, size_t l, size_t r)
+  {
+    uint64_t res = a[l];
+    for (size_t i = l + 1; i <= r; ++i)
+      res = std::min(res, a[i]);
+    return res;
+  }
+
+  inline uint64_t query_blocks(size_t l, size_t r) const
+  {
+    const size_t sl = l >> superblock_bits;
+    const size_t sr = r >> superblock_bits;
+    if (sl == sr)
+      return scan(block_min_view, l, r);
+
+    uint64_t res = std::min(scan(block_min_view, l, ((sl + 1) << superblock_bits) - 1),
+                            scan(block_min_view, sr << superblock_bits, r));
+    if (sl + 1 < sr)
+    {
+      const size_t k = sdsl::bits::hi(sr - sl - 1);
+      res = std::min(res, std::min(table_view[k][sl + 1], table_view[k][sr - (1ULL << k)]));
+    }
+    return res;
+  }
+
+  void build()
+  {
+    const size_t n = v.size();
+    const uint8_t width = v.width();
+
+    const size_t n_blocks = (n + (1ULL << block_bits) - 1) >> block_bits;
+    block_min = sdsl::int_vector<>(n_blocks, 0, width);
+    for (size_t b = 0; b < n_blocks; ++b)
+      block_min[b] = scan(v, b << block_bits, std::min(n, (b + 1) << block_bits) - 1);
+
+    const size_t n_superblocks = (n_blocks + (1ULL << superblock_bits) - 1) >> superblock_bits;
+    table.clear();
+    if (n_superblocks > 0)
+    {
+      table.emplace_back(n_superblocks, 0, width);
+      for (size_t s = 0; s < n_superblocks; ++s)
+        table[0][s] = scan(packed_view(block_min.data(), block_min.size(), block_min.width()),
+                           s << superblock_bits, std::min(n_blocks, (s + 1) << superblock_bits) - 1);
+    }
+    for (size_t k = 1; (1ULL << k) <= n_superblocks; ++k)
+    {
+      const size_t half = 1ULL << (k - 1);
+      table.emplace_back(n_superblocks - (1ULL << k) + 1, 0, width);
+      for (size_t s = 0; s < table[k].size(); ++s)
+        table[k][s] = std::min(table[k - 1][s], table[k - 1][s + half]);
+    }
+
+    set_views();
+  }
+
+  void load_tables(std::istream &in)
+  {
+    block_min.load(in);
+    size_t levels = 0;
+    sdsl::read_member(levels, in);
+    table.resize(levels);
+    for (auto &level : table)
+      level.load(in);
+    set_views();
+  }
+
+  void set_views()
+  {
+    block_min_view = packed_view(block_min.data(), block_min.size(), block_min.width());
+    table_view.clear();
+    for (auto &level : table)
+      table_view.emplace_back(level.data(), level.size(), level.width());
+  }
+};
+
+// Output file with a large user-space buffer. Runs of a character are
+// expanded with memset and fixed-width integers are packed with a single
+// unaligned 8-byte store, so the writes issued to the kernel are large.
+class buffered_writer
+{
+public:
+  buffered_writer() {}
+
+  buffered_writer(std::string filename, size_t buffer_size_ = default_buffer_size)
+  {
+    open(filename, buffer_size_);
+  }
+
+  ~buffered_writer()
+  {
+    close();
+  }
+
+  buffered_writer(const buffered_writer &) = delete;
+  buffered_writer &operator=(const buffered_writer &) = delete;
+
+  // If truncate is false, the content of an existing file is kept, to be overwritten with seek
+  void open(std::string filename_, size_t buffer_size_ = default_buffer_size, bool truncate = true)
+  {
+    close();
+
+    filename = filename_;
+    if ((fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0), 0644)) < 0)
+      error("open() file " + filename + " failed");
+
+    // Keep room for the 8-byte store of the last integer
+    buffer.resize(std::max(buffer_size_, size_t(16)) + sizeof(uint64_t));
+    capacity = buffer.size() - sizeof(uint64_t);
+    used = 0;
+  }
+
+  inline void put(uint8_t c)
+  {
+    if (used == capacity)
+      flush();
+    buffer[used++] = c;
+  }
+
+  // Writes length copies of c
+  inline void fill(uint8_t c, size_t length)
+  {
+    while (length > 0)
+    {
+      if (used == capacity)
+        flush();
+      size_t chunk = std::min(length, capacity - used);
+      memset(&buffer[used], c, chunk);
+      used += chunk;
+      length -= chunk;
+    }
+  }
+
+  // Writes the bytes least significant bytes of value, in little endian
+  inline void write_int(uint64_t value, size_t bytes)
+  {
+    assert(bytes <= sizeof(uint64_t));
+    if (used + bytes > capacity)
+      flush();
+    memcpy(&buffer[used], &value, sizeof(uint64_t));
+    used += bytes;
+  }
+
+  void write(const void *data, size_t length)
+  {
+    const char *p = (const char *)data;
+    while (length > 0)
+    {
+      if (used == capacity)
+        flush();
+      size_t chunk = std::min(length, capacity - used);
+      memcpy(&buffer[used], p, chunk);
+      used += chunk;
+      p += chunk;
+      length -= chunk;
+    }
+  }
+
+  void flush()
+  {
+    size_t written = 0;
+    while (written < used)
+    {
+      ssize_t res = ::write(fd, &buffer[written], used - written);
+      if (res < 0)
+        error("write() file " + filename + " failed");
+      written += res;
+    }
+    used = 0;
+  }
+
+  // Moves the next write to byte offset of the file
+  void seek(size_t offset)
+  {
+    flush();
+    if (lseek(fd, offset, SEEK_SET) < 0)
+      error("lseek() file " + filename + " failed");
+  }
+
+  inline bool is_open() const { return fd >= 0; }
+
+  // Offset of the next write
+  size_t tell()
+  {
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (offset < 0)
+      error("lseek() file " + filename + " failed");
+    return offset + used;
+  }
+
+  // Cuts the file at size bytes, the next write is appended at the end
+  void truncate(size_t size)
+  {
+    flush();
+    if (ftruncate(fd, size) < 0)
+      error("ftruncate() file " + filename + " failed");
+    seek(size);
+  }
+
+  // Flushes the buffer and waits for the file to reach the disk
+  void sync()
+  {
+    flush();
+    if (fsync(fd) < 0)
+      error("fsync() file " + filename + " failed");
+  }
+
+  void close()
+  {
+    if (fd < 0)
+      return;
+    flush();
+    if (::close(fd) < 0)
+      error("close() file " + filename + " failed");
+    fd = -1;
+  }
+
+  static const size_t default_buffer_size = 1ULL << 22;
+
+private:
+  std::string filename;
+  int fd = -1;
+  std::vector<char> buffer;
+  size_t capacity = 0;
+  size_t used = 0;
+};
+
+// Copies the entries of a view in a new vector of the same width
+inline sdsl::int_vector<> to_int_vector(const packed_view &view)
+{
+  sdsl::int_vector<> vec(view.size(), 0, view.width());
+  for (size_t i = 0; i < view.size(); ++i)
+    vec[i] = view[i];
+  return vec;
+}
+
+// Maps the size packed entries of width bits stored in filename in view, for random
+// access. The file is unlinked once mapped, so its blocks are released together with
+// the mapping.
+inline void map_spilled_file(std::string filename, size_t size, uint8_t width,
+                             packed_view &view, std::shared_ptr<mapped_file> &file)
+{
+  file = std::make_shared<mapped_file>(filename);
+  if (unlink(filename.c_str()) < 0)
+    error("unlink() file " + filename + " failed");
+  file->advise(MADV_RANDOM);
+  view = packed_view((const uint64_t *)file->data(), size, width);
+}
+
+// Moves the packed entries of v to filename and maps them back in view.
+inline void spill_to_file(sdsl::int_vector<> &v, std::string filename,
+                          packed_view &view, std::shared_ptr<mapped_file> &file)
+{
+  const size_t size = v.size();
+  const uint8_t width = v.width();
+  {
+    buffered_writer out(filename);
+    out.write(v.data(), ((size * width + 63) >> 6) * sizeof(uint64_t));
+  }
+  v = sdsl::int_vector<>();
+
+  map_spilled_file(filename, size, width, view, file);
+}
+
+// Writes to filename an array of size entries of width bits, that is never held in
+// memory as a whole, and maps it in view. The entries are given in any order, as
+// set(t, k, value) calls from thread t, during a single pass over the input: each pair
+// (k, value) is appended, through a small buffer per thread and per block of block_size
+// entries, to the region of its block in a temporary file of pairs. finish() then reads
+// the region of each block sequentially, fills the block and appends it to filename.
+// The buffers take about as much memory as a block, and the file of pairs takes
+// 2 * sizeof(uint64_t) bytes per entry until finish() returns.
+class block_writer
+{
+public:
+  typedef std::pair<uint64_t, uint64_t> pair_t;
+
+  block_writer(std::string filename_, size_t size_, uint8_t width_, size_t block_size_, size_t n_threads)
+      : filename(filename_), pairs_filename(filename_ + ".pairs"),
+        size(size_), width(width_), block_size(block_size_),
+        n_blocks((size_ + block_size_ - 1) / block_size_),
+        filled(n_blocks, 0),
+        buffers(std::max(size_t(1), n_threads), std::vector<std::vector<pair_t>>(n_blocks))
+  {
+    assert(block_size > 0 and block_size % 64 == 0);
+    const size_t block_bytes = block_size / 8 * width;
+    capacity = std::max(size_t(64), block_bytes / (sizeof(pair_t) * n_blocks * buffers.size()));
+
+    if ((fd = open(pairs_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+      error("open() file " + pairs_filename + " failed");
+    // The file of pairs is released as soon as it is closed
+    if (unlink(pairs_filename.c_str()) < 0)
+      error("unlink() file " + pairs_filename + " failed");
+  }
+
+  ~block_writer()
+  {
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  // Sets the k-th entry to value. Each entry is set once, and each thread t uses only
+  // its own buffers.
+  inline void set(size_t t, size_t k, uint64_t value)
+  {
+    const size_t b = k / block_size;
+    std::vector<pair_t> &buffer = buffers[t][b];
+    if (buffer.capacity() < capacity)
+      buffer.reserve(capacity);
+    buffer.emplace_back(k, value);
+    if (buffer.size() == capacity)
+      flush(buffer, b);
+  }
+
+  // Writes the array to filename and maps it in view. The entries that were never set
+  // are 0.
+  void finish(packed_view &view, std::shared_ptr<mapped_file> &file)
+  {
+    for (auto &thread_buffers : buffers)
+      for (size_t b = 0; b < n_blocks; ++b)
+      {
+        flush(thread_buffers[b], b);
+        std::vector<pair_t>().swap(thread_buffers[b]);
+      }
+
+    {
+      buffered_writer out(filename);
+      std::vector<pair_t> chunk(std::min(block_size, capacity));
+      for (size_t b = 0; b < n_blocks; ++b)
+      {
+        const size_t begin = b * block_size;
+        sdsl::int_vector<> block(std::min(block_size, size - begin), 0, width);
+        for (size_t read = 0; read < filled[b]; read += chunk.size())
+        {
+          const size_t length = std::min(chunk.size(), filled[b] - read);
+          read_at(chunk.data(), length * sizeof(pair_t), (begin + read) * sizeof(pair_t));
+          for (size_t i = 0; i < length; ++i)
+            block[chunk[i].first - begin] = chunk[i].second;
+        }
+        out.write(block.data(), ((block.size() * width + 63) >> 6) * sizeof(uint64_t));
+      }
+    }
+    ::close(fd);
+    fd = -1;
+
+    map_spilled_file(filename, size, width, view, file);
+  }
+
+private:
+  // Appends the pairs in buffer to the region of block b
+  void flush(std::vector<pair_t> &buffer, size_t b)
+  {
+    if (buffer.empty())
+      return;
+    const size_t offset = b * block_size + __atomic_fetch_add(&filled[b], buffer.size(), __ATOMIC_RELAXED);
+    assert(offset + buffer.size() <= std::min((b + 1) * block_size, size));
+    write_at(buffer.data(), buffer.size() * sizeof(pair_t), offset * sizeof(pair_t));
+    buffer.clear();
+  }
+
+  void write_at(const void *data, size_t bytes, size_t offset)
+  {
+    for (size_t done = 0; done < bytes;)
+    {
+      ssize_t res = pwrite(fd, (const char *)data + done, bytes - done, offset + done);
+      if (res < 0)
+        error("pwrite() file " + pairs_filename + " failed");
+      done += res;
+    }
+  }
+
+  void read_at(void *data, size_t bytes, size_t offset)
+  {
+    for (size_t done = 0; done < bytes;)
+    {
+      ssize_t res = pread(fd, (char *)data + done, bytes - done, offset + done);
+      if (res <= 0)
+        error("pread() file " + pairs_filename + " failed");
+      done += res;
+    }
+  }
+
+  std::string filename;
+  std::string pairs_filename;
+  size_t size;
+  uint8_t width;
+  size_t block_size;
+  size_t n_blocks;
+  size_t capacity;
+  std::vector<size_t> filled; // pairs written to the region of each block
+  std::vector<std::vector<std::vector<pair_t>>> buffers; // buffers[t][b]
+  int fd = -1;
+};
+
+// Splits [begin, end) in n_threads contiguous blocks and calls f(block_begin, block_end, t)
+// on the t-th block in its own thread. The split depends only on the range and on
+// n_threads, so two calls with the same arguments see the same blocks.
+template <typename F>
+void parallel_for(size_t begin, size_t end, size_t n_threads, F f)
+{
+  n_threads = std::max(size_t(1), std::min(n_threads, end - begin));
+  if (n_threads == 1)
+  {
+    f(begin, end, size_t(0));
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < n_threads; ++t)
+  {
+    size_t b = begin + (end - begin) * t / n_threads;
+    size_t e = begin + (end - begin) * (t + 1) / n_threads;
+    threads.emplace_back(f, b, e, t);
+  }
+  for (auto &t : threads)
+    t.join();
+}
+
+// Sorts [begin, end) with n_threads threads. The blocks of parallel_for are sorted, then
+// merged in pairs, with the merges of a round in parallel.
+template <typename It, typename Compare>
+void parallel_sort(It begin, It end, size_t n_threads, Compare comp)
+{
+  size_t n = end - begin;
+  n_threads = std::max(size_t(1), std::min(n_threads, n));
+  std::vector<size_t> bounds(n_threads + 1);
+  for (size_t t = 0; t <= n_threads; ++t)
+    bounds[t] = n * t / n_threads;
+
+  parallel_for(0, n, n_threads, [&](size_t b, size_t e, size_t) {
+    std::sort(begin + b, begin + e, comp);
+  });
+
+  for (size_t width = 1; width < n_threads; width *= 2)
+  {
+    size_t n_merges = (n_threads + 2 * width - 1) / (2 * width);
+    parallel_for(0, n_merges, n_merges, [&](size_t b, size_t e, size_t) {
+      for (size_t m = b; m < e; ++m)
+      {
+        size_t first = 2 * width * m;
+        size_t mid = std::min(first + width, n_threads);
+        size_t last = std::min(first + 2 * width, n_threads);
+        if (mid < last)
+          std::inplace_merge(begin + bounds[first], begin + bounds[mid], begin + bounds[last], comp);
+      }
+    });
+  }
+}
+
+// Number of bits needed to store the values in [0, max_value]
+inline uint8_t width_of(uint64_t max_value)
+{
+  return sdsl::bits::hi(max_value) + 1;
+}
+
+// Length of the longest common prefix of a[0, len) and b[0, len). The bytes are
+// compared a word at a time, and the first different byte of a word is found from
+// the lowest bit set in the xor of the words (the words are little-endian).
+inline size_t common_prefix(const uint8_t *a, const uint8_t *b, size_t len)
+{
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8)
+  {
+    uint64_t x, y;
+    memcpy(&x, a + i, 8);
+    memcpy(&y, b + i, 8);
+    if (x != y)
+      return i + (__builtin_ctzll(x ^ y) >> 3);
+  }
+  while (i < len && a[i] == b[i])
+    ++i;
+  return i;
+}
+
+// Sets v[i] = x in an entry of v that is still zero. Threads can set distinct
+// entries of v at the same time, also when the entries share a word.
+inline void set_packed_concurrent(sdsl::int_vector<> &v, size_t i, uint64_t x)
+{
+  assert(x == 0 || width_of(x) <= v.width());
+  const uint8_t width = v.width();
+  const uint64_t bit = i * width;
+  const uint8_t offset = bit & 63;
+  uint64_t *word = v.data() + (bit >> 6);
+
+  __atomic_fetch_or(word, x << offset, __ATOMIC_RELAXED);
+  if (offset + width > 64)
+    __atomic_fetch_or(word + 1, x >> (64 - offset), __ATOMIC_RELAXED);
+}
+
 //*********************** Time resources ***************************************
 
 /*!
@@ -335,6 +1106,14 @@ struct Args
   bool rle   = false; // outut RLEBWT
   std::string patterns = ""; // path to patterns file
   bool is_fasta = false; // read a fasta file
+  size_t th = 1; // number of threads
+  bool lcp = false; // output the LCP array
+  bool parse = false; // compute the prefix-free parsing in memory
+  size_t mod = 100; // hash modulus of the prefix-free parsing
+  size_t budget = 0; // memory budget in MiB of the arrays of the parse, 0 for no limit
+  size_t checkpoint = 0; // seconds between two checkpoints of the scan, 0 for no checkpoints
+  bool index = false; // build the matching statistics index in the scan
+  bool lce = false; // compute the matching statistics lengths with fingerprints
 };
 
 void parseArgs(int argc, char *const argv[], Args &arg)
@@ -343,18 +1122,26 @@ void parseArgs(int argc, char *const argv[], Args &arg)
   extern char *optarg;
   extern int optind;
 
-  std::string usage("usage: " + std::string(argv[0]) + " -i infile [-s store] [-m memo] [-c csv] [-p patterns] [-f fasta] [-r rle]\n\n" +
+  std::string usage("usage: " + std::string(argv[0]) + " -i infile [-s store] [-m memo] [-c csv] [-p patterns] [-f fasta] [-r rle] [-l lcp] [-a parse] [-k mod] [-b budget] [-C checkpoint] [-x index] [-e lce] [-t threads]\n\n" +
                     "Computes the pfp data structures of infile, provided that infile.parse, infile.dict, and infile.occ exists.\n" +
                     "  wsize: [integer] - sliding window size (def. 10)\n" +
                     "  store: [boolean] - store the data structure in infile.pfp.ds. (def. false)\n" +
                     "   memo: [boolean] - print the data structure memory usage. (def. false)\n" +
                     "  fasta: [boolean] - the input file is a fasta file. (def. false)\n" +
                     "    rle: [boolean] - output run length encoded BWT. (def. false)\n" +
+                    "    lcp: [boolean] - output the LCP array in the same pass of the thresholds. (def. false)\n" +
+                    "  parse: [boolean] - compute the prefix-free parsing of infile in memory, instead of reading it. (def. false)\n" +
+                    "    mod: [integer] - hash modulus of the prefix-free parsing. (def. 100)\n" +
+                    " budget: [integer] - memory budget in MiB of the arrays of the parse, over it the auxiliary ones are mapped from disk; the parse, its SA and ISA stay in memory. (def. 0, no limit)\n" +
+                    "checkpoint: [integer] - seconds between two checkpoints of the scan in infile.ckpt, a later run resumes from it. (def. 0, no checkpoints)\n" +
+                    "  index: [boolean] - build the matching statistics index infile.ms from the runs of the BWT, without writing the BWT. (def. false)\n" +
+                    "    lce: [boolean] - compute the lengths of the matching statistics with Karp-Rabin fingerprints. (def. false)\n" +
                     "pattens: [string]  - path to patterns file.\n" +
+                    "threads: [integer] - number of threads. (def. 1)\n" +
                     "    csv: [boolean] - print the stats in csv form on strerr. (def. false)\n");
 
   std::string sarg;
-  while ((c = getopt(argc, argv, "w:smcfrhp:i:")) != -1)
+  while ((c = getopt(argc, argv, "w:smcfrlak:b:C:xehp:i:t:")) != -1)
   {
     switch (c)
     {
@@ -378,12 +1165,40 @@ void parseArgs(int argc, char *const argv[], Args &arg)
     case 'r':
       arg.rle = true;
       break;
+    case 'l':
+      arg.lcp = true;
+      break;
+    case 'a':
+      arg.parse = true;
+      break;
+    case 'k':
+      sarg.assign(optarg);
+      arg.mod = stoi(sarg);
+      break;
+    case 'b':
+      sarg.assign(optarg);
+      arg.budget = stoull(sarg);
+      break;
+    case 'x':
+      arg.index = true;
+      break;
+    case 'e':
+      arg.lce = true;
+      break;
+    case 'C':
+      sarg.assign(optarg);
+      arg.checkpoint = stoull(sarg);
+      break;
     case 'p':
       arg.patterns.assign(optarg);
       break;
     case 'f':
       arg.is_fasta = true;
       break;
+    case 't':
+      sarg.assign(optarg);
+      arg.th = stoi(sarg);
+      break;
     case 'h':
       error(usage);
     case '?':
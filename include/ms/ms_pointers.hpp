@@ -41,7 +41,8 @@ class ms_pointers : ri::r_index<sparse_bv_type, rle_string_t>
 {
 public:
 
-    std::vector<size_t> thresholds;
+    // std::vector<size_t> thresholds;
+    int_vector<> thresholds;
 
     // std::vector<ulint> samples_start;
     int_vector<> samples_start;
@@ -62,7 +63,107 @@ public:
 
     typedef size_t size_type;
 
-    ms_pointers(std::string filename, bool rle = false) : 
+    // Default constructor for load
+    ms_pointers() {}
+
+    // The views point into the members, or into the mapping of this object
+    ms_pointers(const ms_pointers &) = delete;
+    ms_pointers &operator=(const ms_pointers &) = delete;
+
+    // Collects the runs of the BWT in order, with their SA samples and thresholds, as
+    // they are computed by pfp_thresholds.
+    class builder
+    {
+    public:
+        // n is the length of the BWT
+        builder(ulint n) : log_n(bitsize(uint64_t(n))),
+                           lengths(0, 0, log_n),
+                           samples_start(0, 0, log_n),
+                           samples_last(0, 0, log_n),
+                           thresholds(0, 0, log_n)
+        {
+        }
+
+        // ssa and esa are the SA samples at the beginning and at the end of the run,
+        // in the format of infile.ssa and infile.esa
+        void push(uint8_t head, ulint length, ulint ssa, ulint esa, ulint threshold)
+        {
+            if (r == lengths.size())
+                resize(std::max(2 * r, ulint(1024)));
+
+            heads.push_back(head);
+            lengths[r] = length;
+            samples_start[r] = ssa;
+            samples_last[r] = esa;
+            thresholds[r] = threshold;
+            r++;
+        }
+
+    private:
+        friend class ms_pointers;
+
+        int log_n;
+        ulint r = 0;
+
+        string heads;
+        int_vector<> lengths;
+        int_vector<> samples_start;
+        int_vector<> samples_last;
+        int_vector<> thresholds;
+
+        void resize(ulint size)
+        {
+            lengths.resize(size);
+            samples_start.resize(size);
+            samples_last.resize(size);
+            thresholds.resize(size);
+        }
+    };
+
+    // Builds the index from the runs collected by the builder, that is emptied.
+    // The run-length BWT is built by n_threads threads.
+    ms_pointers(builder &b, size_t n_threads = 1) :
+        ri::r_index<sparse_bv_type, rle_string_t>()
+    {
+        verbose("Building the r-index from the BWT runs");
+
+        std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
+
+        b.resize(b.r);
+
+        this->r = b.r;
+        this->bwt = rle_string_t(b.heads, b.lengths, 2, n_threads);
+        string().swap(b.heads);
+        b.lengths = int_vector<>();
+
+        build_F_from_bwt();
+
+        verbose("Number of BWT equal-letter runs: r = " , this->r);
+        verbose("Rate n/r = " , double(this->bwt.size()) / this->r);
+
+        // Same samples of read_samples
+        for (auto samples : {&b.samples_start, &b.samples_last})
+            for (size_t i = 0; i < samples->size(); ++i)
+            {
+                ulint right = (*samples)[i];
+                (*samples)[i] = (right ? right - 1 : this->r - 1);
+            }
+        samples_start = std::move(b.samples_start);
+        this->samples_last = std::move(b.samples_last);
+        thresholds = std::move(b.thresholds);
+
+        verbose("Thresholds size (bytes): ", sdsl::size_in_bytes(thresholds));
+
+        set_views();
+
+        std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
+
+        verbose("R-index construction complete");
+        verbose("Memory peak: ", malloc_count_peak());
+        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
+    }
+
+    ms_pointers(std::string filename, bool rle = false, size_t n_threads = 1) : 
         ri::r_index<sparse_bv_type, rle_string_t>()
     {
         verbose("Building the r-index from BWT");
@@ -79,20 +180,15 @@ public:
             std::ifstream ifs_heads(bwt_heads_fname);
             std::string bwt_len_fname = bwt_fname + ".len";
             std::ifstream ifs_len(bwt_len_fname);
-            this->bwt = rle_string_t(ifs_heads, ifs_len);
-
-            ifs_heads.seekg(0);
-            ifs_len.seekg(0);
-            this->build_F_(ifs_heads, ifs_len);
+            this->bwt = rle_string_t(ifs_heads, ifs_len, 2, n_threads);
         }
         else
         {
             std::ifstream ifs(bwt_fname);
-            this->bwt = rle_string_t(ifs);
-
-            ifs.seekg(0);
-            this->build_F(ifs);
+            this->bwt = rle_string_t(ifs, 2, n_threads);
         }
+        // The occurrences of each character are counted while building the runs
+        build_F_from_bwt();
         // std::string istring;
         // read_file(bwt_fname.c_str(), istring);
         // for(size_t i = 0; i < istring.size(); ++i)
@@ -132,27 +228,20 @@ public:
 
         std::string tmp_filename = filename + std::string(".thr_pos");
 
-        struct stat filestat;
-        FILE *fd;
-
-        if ((fd = fopen(tmp_filename.c_str(), "r")) == nullptr)
-            error("open() file " + tmp_filename + " failed");
-
-        int fn = fileno(fd);
-        if (fstat(fn, &filestat) < 0)
-            error("stat() file " + tmp_filename + " failed");
+        // The thresholds are positions in the BWT, so they fit in log_n bits
+        thresholds = int_vector<>(this->r, 0, log_n);
 
-        if (filestat.st_size % THRBYTES != 0)
+        size_t length = read_packed_file(tmp_filename, THRBYTES, [&](size_t i, uint64_t threshold) {
+            if (i < this->r)
+                thresholds[i] = threshold;
+        });
+        //Check that the length of the file is r elements of 5 bytes
+        if (length != this->r)
             error("invilid file " + tmp_filename);
 
-        size_t length = filestat.st_size / THRBYTES;
-        thresholds.resize(length);
+        verbose("Thresholds size (bytes): ", sdsl::size_in_bytes(thresholds));
 
-        for(size_t i = 0; i < length; ++i )
-            if ((fread(&thresholds[i], THRBYTES, 1, fd)) != 1)
-                error("fread() file " + tmp_filename + " failed");
-
-        fclose(fd);
+        set_views();
 
         t_insert_end = std::chrono::high_resolution_clock::now();
 
@@ -163,70 +252,49 @@ public:
 
     void read_samples(std::string filename, ulint r, int log_n, int_vector<> &samples)
     {
-
-        struct stat filestat;
-        FILE *fd;
-
-        if ((fd = fopen(filename.c_str(), "r")) == nullptr)
-            error("open() file " + filename + " failed");
-
-        int fn = fileno(fd);
-        if (fstat(fn, &filestat) < 0)
-            error("stat() file " + filename + " failed");
-
-        if (filestat.st_size % SSABYTES != 0)
-            error("invilid file " + filename);
-
-        size_t length = filestat.st_size / (2*SSABYTES);
-        //Check that the length of the file is 2*r elements of 5 bytes
-        assert(length == r);
-
         // Create the vector
         samples = int_vector<>(r, 0, log_n);
 
-        // Read the vector
-        uint64_t left = 0;
-        uint64_t right = 0;
-        size_t i = 0;
-        while (fread((char *)&left, SSABYTES, 1, fd) && fread((char *)&right, SSABYTES, 1,fd))
-        {
-            ulint val = (right ? right - 1 : r - 1);
-            assert(bitsize(uint64_t(val)) <= log_n);
-            samples[i++] = val;
-        }
-
-        fclose(fd);
+        // The file stores pairs of 5 bytes values, we keep the right one
+        size_t length = read_packed_file(filename, SSABYTES, [&](size_t i, uint64_t right) {
+            if ((i & 1) and (i >> 1) < r)
+            {
+                ulint val = (right ? right - 1 : r - 1);
+                assert(bitsize(uint64_t(val)) <= log_n);
+                samples[i >> 1] = val;
+            }
+        });
+        //Check that the length of the file is 2*r elements of 5 bytes
+        if (length != 2 * r)
+            error("invilid file " + filename);
     }
 
-    vector<ulint> build_F_(std::ifstream &heads, std::ifstream &lengths)
+    // Computes F from the number of occurrences of each character in the run-length
+    // encoded BWT, without reading the BWT again
+    vector<ulint> build_F_from_bwt()
     {
-        heads.clear();
-        heads.seekg(0);
-        lengths.clear();
-        lengths.seekg(0);
-
         this->F = vector<ulint>(256, 0);
-        int c;
-        ulint i = 0;
-        while ((c = heads.get()) != EOF)
-        {
-            size_t length;
-            lengths.read((char *)&length, 5);
-            if (c > TERMINATOR)
-                this->F[c]+=length;
-            else
-            {
-                this->F[TERMINATOR]+=length;
-                this->terminator_position = i;
-            }
-            i++;
-        }
+        for (ulint c = 0; c < 256; ++c)
+            this->F[c] = this->bwt.number_of_letter(c);
+        if (this->F[TERMINATOR] > 0)
+            this->terminator_position = this->bwt.select(0, TERMINATOR);
+        prefix_sums_of_F();
+        return this->F;
+    }
+
+    // Turns the number of occurrences of each character in F into the number of smaller characters
+    void prefix_sums_of_F()
+    {
         for (ulint i = 255; i > 0; --i)
             this->F[i] = this->F[i - 1];
         this->F[0] = 0;
         for (ulint i = 1; i < 256; ++i)
             this->F[i] += this->F[i - 1];
-        return this->F;
+    }
+
+    ulint get_last_run_sample()
+    {
+        return (samples_last_view[this->r - 1] + 1) % this->bwt.size();
     }
 
     // Computes the matching statistics pointers for the given pattern
@@ -267,11 +335,11 @@ public:
                     ri::ulint j = this->bwt.select(rnk, c);
                     ri::ulint run_of_j = this->bwt.run_of_position(j);
 
-                    thr = thresholds[run_of_j]; // If it is the first run thr = 0
+                    thr = thresholds_view[run_of_j]; // If it is the first run thr = 0
 
                     // Here we should use Phi_inv that is not implemented yet
                     // sample = this->Phi(this->samples_last[run_of_j - 1]) - 1;
-                    sample = samples_start[run_of_j];
+                    sample = samples_start_view[run_of_j];
 
                     next_pos = j;
                 }
@@ -282,7 +350,7 @@ public:
                     rnk--;
                     ri::ulint j = this->bwt.select(rnk, c);
                     ri::ulint run_of_j = this->bwt.run_of_position(j);
-                    sample = this->samples_last[run_of_j];
+                    sample = samples_last_view[run_of_j];
 
                     next_pos = j;
                 }
@@ -328,11 +396,24 @@ public:
         written_bytes += sizeof(this->terminator_position);
         written_bytes += my_serialize(this->F, out, child, "F");
         written_bytes += this->bwt.serialize(out);
-        written_bytes += this->samples_last.serialize(out);
 
-        written_bytes += my_serialize(thresholds, out, child, "thresholds");
-        // written_bytes += my_serialize(samples_start, out, child, "samples_start");
-        written_bytes += samples_start.serialize(out, child, "samples_start");
+        if (mapping)
+        {
+            // The vectors are in the mapped file
+            written_bytes += to_int_vector(samples_last_view).serialize(out);
+
+            written_bytes += to_int_vector(thresholds_view).serialize(out, child, "thresholds");
+            written_bytes += to_int_vector(samples_start_view).serialize(out, child, "samples_start");
+        }
+        else
+        {
+            written_bytes += this->samples_last.serialize(out);
+
+            // written_bytes += my_serialize(thresholds, out, child, "thresholds");
+            written_bytes += thresholds.serialize(out, child, "thresholds");
+            // written_bytes += my_serialize(samples_start, out, child, "samples_start");
+            written_bytes += samples_start.serialize(out, child, "samples_start");
+        }
 
         sdsl::structure_tree::add_size(child, written_bytes);
         return written_bytes;
@@ -348,13 +429,116 @@ public:
         my_load(this->F, in);
         this->bwt.load(in);
         this->r = this->bwt.number_of_runs();
-        this->pred.load(in);
         this->samples_last.load(in);
-        this->pred_to_run.load(in);
 
-        my_load(thresholds,in);
+        // my_load(thresholds,in);
+        thresholds.load(in);
         samples_start.load(in);
         // my_load(samples_start,in);
+
+        set_views();
+    }
+
+    /* serialize the structure in the memory-mappable layout of load_mapped()
+     * \param out     the ostream
+     */
+    size_type serialize_mapped(std::ostream &out)
+    {
+        std::stringstream bwt_ss;
+        this->bwt.serialize(bwt_ss);
+        std::string bwt_s = bwt_ss.str();
+
+        header_t header;
+        header.terminator_position = this->terminator_position;
+        header.r = this->r;
+
+        size_t offset = align_section(sizeof(header_t));
+        auto add_section = [&](section_id id, size_t bytes, size_t size, size_t width) {
+            header.sections[id] = {offset, bytes, size, width};
+            offset = align_section(offset + bytes);
+        };
+        add_section(F_SECTION, this->F.size() * sizeof(this->F[0]), this->F.size(), 64);
+        add_section(BWT_SECTION, bwt_s.size(), bwt_s.size(), 8);
+        add_section(THR_SECTION, thresholds_view.bytes(), thresholds_view.size(), thresholds_view.width());
+        add_section(SSA_SECTION, samples_start_view.bytes(), samples_start_view.size(), samples_start_view.width());
+        add_section(ESA_SECTION, samples_last_view.bytes(), samples_last_view.size(), samples_last_view.width());
+
+        size_type written_bytes = 0;
+        auto write_section = [&](const char *data, size_t bytes) {
+            // Pad up to the beginning of the section
+            const char zeros[MS_SECTION_ALIGNMENT] = {0};
+            out.write(zeros, align_section(written_bytes) - written_bytes);
+            written_bytes = align_section(written_bytes);
+
+            out.write(data, bytes);
+            written_bytes += bytes;
+        };
+        write_section((const char *)&header, sizeof(header_t));
+        write_section((const char *)this->F.data(), header.sections[F_SECTION].bytes);
+        write_section(bwt_s.data(), bwt_s.size());
+        write_section((const char *)thresholds_view.words(), thresholds_view.bytes());
+        write_section((const char *)samples_start_view.words(), samples_start_view.bytes());
+        write_section((const char *)samples_last_view.words(), samples_last_view.bytes());
+
+        return written_bytes;
+    }
+
+    /* map a structure serialized with serialize_mapped()
+     * The thresholds and the samples are queried in place from the mapping,
+     * which is shared with all the other processes mapping the same file.
+     * The run-length BWT is not: it is deserialized in memory, so it takes
+     * the time and the space of a load() of the BWT.
+     * \param filename the file name
+     */
+    void load_mapped(std::string filename)
+    {
+        mapping = std::make_shared<mapped_file>(filename);
+        const char *base = mapping->data();
+
+        if (mapping->size() < sizeof(header_t))
+            error("invilid file " + filename);
+
+        const header_t *header = (const header_t *)base;
+        if (header->magic != MS_MAGIC)
+            error("invilid file " + filename);
+        for (size_t i = 0; i < N_SECTIONS; ++i)
+            if (header->sections[i].offset + header->sections[i].bytes > mapping->size())
+                error("invilid file " + filename);
+
+        this->terminator_position = header->terminator_position;
+
+        const section_t &f_section = header->sections[F_SECTION];
+        const ulint *f_begin = (const ulint *)(base + f_section.offset);
+        this->F = vector<ulint>(f_begin, f_begin + f_section.size);
+
+        // The r-index bitvectors and run heads cannot be queried on a buffer,
+        // so the run-length BWT is loaded through its own load function
+        const section_t &bwt_section = header->sections[BWT_SECTION];
+        memory_streambuf bwt_buf(base + bwt_section.offset, bwt_section.bytes);
+        std::istream bwt_in(&bwt_buf);
+        this->bwt.load(bwt_in);
+        this->r = this->bwt.number_of_runs();
+        assert(this->r == header->r);
+
+        // Release the vectors of a previous construction
+        thresholds = int_vector<>();
+        samples_start = int_vector<>();
+        this->samples_last = int_vector<>();
+
+        thresholds_view = section_view(header->sections[THR_SECTION]);
+        samples_start_view = section_view(header->sections[SSA_SECTION]);
+        samples_last_view = section_view(header->sections[ESA_SECTION]);
+    }
+
+    std::string filesuffix() const
+    {
+        return ".ms";
+    }
+
+    // Size in bytes of the bit-packed thresholds
+    size_t thresholds_size_in_bytes() const
+    {
+        return thresholds_view.bytes();
     }
 
     // // From r-index
@@ -365,6 +549,61 @@ public:
 
     protected :
 
+        // Views used by the queries, on the vectors above or on the mapped file
+        packed_view thresholds_view;
+        packed_view samples_start_view;
+        packed_view samples_last_view;
+
+        std::shared_ptr<mapped_file> mapping;
+
+        // Layout of the memory-mappable file: a header followed by aligned sections
+        static const uint64_t MS_MAGIC = 0x3130535254504d53ULL; // "SMPTRS01"
+        static const size_t MS_SECTION_ALIGNMENT = 64;
+
+        enum section_id
+        {
+            F_SECTION,
+            BWT_SECTION,
+            THR_SECTION,
+            SSA_SECTION,
+            ESA_SECTION,
+            N_SECTIONS
+        };
+
+        typedef struct
+        {
+            uint64_t offset; // Offset of the section from the beginning of the file
+            uint64_t bytes;  // Size of the section in bytes
+            uint64_t size;   // Number of elements
+            uint64_t width;  // Width in bits of the elements
+        } section_t;
+
+        typedef struct
+        {
+            uint64_t magic = MS_MAGIC;
+            uint64_t terminator_position = 0;
+            uint64_t r = 0;
+            section_t sections[N_SECTIONS];
+        } header_t;
+
+        static inline size_t align_section(size_t offset)
+        {
+            return (offset + MS_SECTION_ALIGNMENT - 1) / MS_SECTION_ALIGNMENT * MS_SECTION_ALIGNMENT;
+        }
+
+        inline packed_view section_view(const section_t &section)
+        {
+            return packed_view((const uint64_t *)(mapping->data() + section.offset), section.size, section.width);
+        }
+
+        // Points the views to the vectors
+        void set_views()
+        {
+            thresholds_view = packed_view(thresholds.data(), thresholds.size(), thresholds.width());
+            samples_start_view = packed_view(samples_start.data(), samples_start.size(), samples_start.width());
+            samples_last_view = packed_view(this->samples_last.data(), this->samples_last.size(), this->samples_last.width());
+        }
+
         // // From r-index
         // vector<ulint> build_F(std::ifstream &ifs)
         // {
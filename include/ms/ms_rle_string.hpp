@@ -26,6 +26,10 @@
 
 #include <common.hpp>
 
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+
 #include <rle_string.hpp>
 
 
@@ -55,22 +59,39 @@ class ms_rle_string : public ri::rle_string<sparse_bitvector_t, string_t>
         // NtD
     }
 
-    ms_rle_string(std::ifstream &ifs, ulint B = 2) : 
-        ri::rle_string<sparse_bitvector_t, string_t>(ifs, B)
+    // Construction from the BWT. The bitvectors and the run heads are built by n_threads threads.
+    ms_rle_string(std::ifstream &ifs, ulint B = 2, size_t n_threads = 1)
     {
+        ifs.clear(); ifs.seekg(0);
 
+        // Splits the BWT in runs
+        string run_heads_s;
+        vector<ulint> lengths;
+        vector<char> buffer(1 << 20);
+        while (ifs.read(buffer.data(), buffer.size()) or ifs.gcount() > 0)
+        {
+            for (std::streamsize k = 0; k < ifs.gcount(); ++k)
+            {
+                char c = ((uchar)buffer[k] <= TERMINATOR ? TERMINATOR : buffer[k]);
+                if (run_heads_s.empty() or run_heads_s.back() != c)
+                {
+                    run_heads_s.push_back(c);
+                    lengths.push_back(0);
+                }
+                lengths.back()++;
+            }
+        }
+
+        size_t i = 0;
+        build_runs(run_heads_s, [&]() {
+            return lengths[i++];
+        }, B, n_threads);
     }
 
     // Construction from run-length encoded BWT
-    ms_rle_string(std::ifstream& heads, std::ifstream& lengths, ulint B = 2) {
+    ms_rle_string(std::ifstream& heads, std::ifstream& lengths, ulint B = 2, size_t n_threads = 1) {
         heads.clear(); heads.seekg(0);
         lengths.clear(); lengths.seekg(0);
-        // assert(not contains0(input)); // We're hacking the 0 away :)
-        this->B = B;
-        // n = input.size();
-        auto runs_per_letter_bv = vector<vector<bool> >(256);
-        //runs in main bitvector
-        vector<bool> runs_bv;
 
         // Reads the run heads
         string run_heads_s;
@@ -79,40 +100,19 @@ class ms_rle_string : public ri::rle_string<sparse_bitvector_t, string_t>
         heads.seekg(0, heads.beg);
         heads.read(&run_heads_s[0], run_heads_s.size());
 
-        size_t pos = 0;
-        this->n = 0;
-        this->R = run_heads_s.size();
-        // Compute runs_bv and runs_per_letter_bv
-        for (size_t i = 0; i < run_heads_s.size(); ++i)
-        {
-            size_t length;
+        build_runs(run_heads_s, [&]() {
+            size_t length = 0;
             lengths.read((char*)&length, 5);
-            if(run_heads_s[i]<=TERMINATOR) // change 0 to 1
-                run_heads_s[i]=TERMINATOR;
-
-            std::fill_n( std::back_inserter(runs_bv), length-1, false);
-            runs_bv.push_back(i%B==B-1);
-
-            std::fill_n( std::back_inserter(runs_per_letter_bv[run_heads_s[i]]), length-1, false);
-            runs_per_letter_bv[run_heads_s[i]].push_back(true);
-
-            this->n += length;
-        }
-        runs_bv.push_back(false);
+            return length;
+        }, B, n_threads);
+    }
 
-        //now compact structures
-        assert(runs_bv.size()==this->n);
-        ulint t = 0;
-        for(ulint i=0;i<256;++i)
-            t += runs_per_letter_bv[i].size();
-        assert(t==this->n);
-        this->runs = sparse_bitvector_t(runs_bv);
-        //a fast direct array: char -> bitvector.
-        this->runs_per_letter = vector<sparse_bitvector_t>(256);
-        for(ulint i=0;i<256;++i)
-            this->runs_per_letter[i] = sparse_bitvector_t(runs_per_letter_bv[i]);
-        this->run_heads = string_t(run_heads_s);
-        assert(this->run_heads.size()==this->R);
+    // Construction from the run heads and the run lengths in memory
+    ms_rle_string(string& run_heads_s, const int_vector<>& lengths, ulint B = 2, size_t n_threads = 1) {
+        size_t i = 0;
+        build_runs(run_heads_s, [&]() {
+            return lengths[i++];
+        }, B, n_threads);
     }
 
     size_t number_of_runs_of_letter(uint8_t c)
@@ -142,6 +142,83 @@ class ms_rle_string : public ri::rle_string<sparse_bitvector_t, string_t>
     }
 
     private :
+
+    // Builds the structures from the run heads and from a function returning the length of the next run.
+    // Only the positions of the ones of the bitvectors are stored, so the memory is O(r) words.
+    // The runs are partitioned by letter in one pass, then the bitvector of each letter, the main
+    // bitvector and the run heads are built in parallel.
+    template <typename next_length_t>
+    void build_runs(string& run_heads_s, next_length_t next_length, ulint B, size_t n_threads = 1)
+    {
+        // assert(not contains0(input)); // We're hacking the 0 away :)
+        this->B = B;
+        // Ones of the main bitvector, and ones and length of the bitvector of each letter
+        vector<ulint> runs_onset;
+        auto runs_per_letter_onset = vector<vector<ulint> >(256);
+        auto runs_per_letter_size = vector<ulint>(256, 0);
+
+        this->n = 0;
+        this->R = run_heads_s.size();
+        for (size_t i = 0; i < run_heads_s.size(); ++i)
+        {
+            size_t length = next_length();
+            assert(length > 0);
+            if((uchar)run_heads_s[i]<=TERMINATOR) // change 0 to 1
+                run_heads_s[i]=TERMINATOR;
+            uchar c = run_heads_s[i];
+
+            // As in rle_string, the last run does not end a block
+            if (i % B == B - 1 and i + 1 < run_heads_s.size())
+                runs_onset.push_back(this->n + length - 1);
+
+            runs_per_letter_size[c] += length;
+            runs_per_letter_onset[c].push_back(runs_per_letter_size[c] - 1);
+
+            this->n += length;
+        }
+
+        //now compact structures
+        ulint t = 0;
+        for(ulint i=0;i<256;++i)
+            t += runs_per_letter_size[i];
+        assert(t==this->n);
+        //a fast direct array: char -> bitvector.
+        this->runs_per_letter = vector<sparse_bitvector_t>(256);
+
+        // Tasks 0 to 255 build the bitvectors of the letters, 256 the main bitvector and 257
+        // the run heads. The threads take the largest tasks first.
+        const size_t runs_task = 256, heads_task = 257;
+        auto task_size = [&](size_t k) {
+            return (k < runs_task ? runs_per_letter_onset[k].size() : (k == runs_task ? runs_onset.size() : this->R));
+        };
+        vector<size_t> tasks(258);
+        std::iota(tasks.begin(), tasks.end(), 0);
+        std::stable_sort(tasks.begin(), tasks.end(), [&](size_t a, size_t b) {
+            return task_size(a) > task_size(b);
+        });
+
+        std::atomic<size_t> next_task(0);
+        parallel_for(0, n_threads, n_threads, [&](size_t, size_t, size_t) {
+            size_t k;
+            while ((k = next_task++) < tasks.size())
+            {
+                size_t task = tasks[k];
+                if (task == runs_task)
+                {
+                    this->runs = sparse_bitvector_t(runs_onset, this->n);
+                    vector<ulint>().swap(runs_onset);
+                }
+                else if (task == heads_task)
+                    this->run_heads = string_t(run_heads_s);
+                else
+                {
+                    this->runs_per_letter[task] = sparse_bitvector_t(runs_per_letter_onset[task], runs_per_letter_size[task]);
+                    vector<ulint>().swap(runs_per_letter_onset[task]);
+                }
+            }
+        });
+        assert(this->run_heads.size()==this->R);
+    }
 };
 
 typedef ms_rle_string<ri::sparse_sd_vector> ms_rle_string_sd;
@@ -41,13 +41,19 @@ class dictionary{
 public:
   std::vector<uint8_t> d;
   std::vector<uint_t> saD;
-  std::vector<uint_t> isaD;
+  sdsl::int_vector<> isaD;
   std::vector<int_t> lcpD;
   sdsl::rmq_succinct_sct<> rmq_lcp_D;
   sdsl::bit_vector b_d; // Starting position of each phrase in D
   sdsl::bit_vector::rank_1_type rank_b_d;
   sdsl::bit_vector::select_1_type select_b_d;
 
+  // Phrase metadata of each suffix of D, laid out in saD order
+  sdsl::int_vector<> phrase_saD; // rank_b_d(saD[i])
+  sdsl::int_vector<> suffix_length_saD; // length of the suffix up to the EndOfWord
+  sdsl::bit_vector valid_saD; // suffix of length at least w, not a complete phrase
+  std::vector<uint8_t> bwt_char_saD; // preceding character of valid suffixes
+
   std::vector<uint8_t> alphabet;
 
   typedef size_t size_type;
@@ -55,11 +61,14 @@ public:
   // default constructor for load.
   dictionary() {}
 
+  // d_ is in the format of infile.dict, and it is moved in the dictionary
   dictionary( std::vector<uint8_t>& d_,
               size_t w ):
-              d(d_)
+              d(std::move(d_))
   {
-    build();
+    prepend_dollars(w);
+
+    build(w);
 
   }
 
@@ -69,6 +78,15 @@ public:
     // Building dictionary from file
     std::string tmp_filename = filename + std::string(".dict");
     read_file(tmp_filename.c_str(), d);
+
+    prepend_dollars(w);
+
+    build(w);
+
+  }
+
+  void prepend_dollars(size_t w)
+  {
     assert(d[0] == Dollar);
     // Prepending w dollars to d
     // 1. Count how many dollars there are
@@ -78,9 +96,6 @@ public:
       ++n_dollars;
     std::vector<uint8_t> dollars(w-n_dollars,Dollar);
     d.insert(d.begin(), dollars.begin(),dollars.end());
-
-    build();
-
   }
 
   inline size_t length_of_phrase(size_t id){
@@ -108,7 +123,7 @@ public:
 
   }
 
-  void build(){
+  void build(size_t w){
 
     // Constructing the alphabet
     std::vector<bool> visit(256,false);
@@ -146,8 +161,8 @@ public:
     verbose("Computing ISA of dictionary");
     _elapsed_time(
       {
-        isaD.resize(d.size());
-        for(int i = 0; i < saD.size(); ++i){
+        isaD = sdsl::int_vector<>(d.size(), 0, width_of(d.size()));
+        for(size_t i = 0; i < saD.size(); ++i){
           isaD[saD[i]] = i;
         }
       }
@@ -159,11 +174,52 @@ public:
     _elapsed_time(
       rmq_lcp_D = sdsl::rmq_succinct_sct<>(&lcpD)
     );
-    
 
+    verbose("Computing phrase metadata of the suffixes of dictionary");
+    _elapsed_time(
+      compute_saD_metadata(w)
+    );
+
+  }
+
+  // Fills phrase_saD, suffix_length_saD, valid_saD, and bwt_char_saD scanning D
+  // phrase by phrase, so that the scans over saD do not query rank_b_d and select_b_d.
+  void compute_saD_metadata(size_t w)
+  {
+    const size_t n_ph = n_phrases();
+
+    size_t max_length = 0;
+    for(size_t k = 1; k <= n_ph; ++k)
+      max_length = std::max(max_length, length_of_phrase(k));
+
+    phrase_saD = sdsl::int_vector<>(d.size(), 0, width_of(n_ph));
+    suffix_length_saD = sdsl::int_vector<>(d.size(), 0, width_of(max_length));
+    valid_saD = sdsl::bit_vector(d.size(), 0);
+    bwt_char_saD = std::vector<uint8_t>(d.size(), 0);
+
+    // The k-th phrase spans [select_b_d(k), select_b_d(k+1)), the last position
+    // is the EndOfDict, which is not a valid suffix.
+    size_t start = 0;
+    for(size_t k = 1; k <= n_ph; ++k)
+    {
+      const size_t end = select_b_d(k + 1);
+      for(size_t sn = start; sn < end; ++sn)
+      {
+        const size_t i = isaD[sn];
+        const size_t suffix_length = end - sn - 1;
+        phrase_saD[i] = (sn == start ? k - 1 : k);
+        suffix_length_saD[i] = suffix_length;
+        if(sn >= w and sn != start and suffix_length >= w)
+        {
+          valid_saD[i] = true;
+          bwt_char_saD[i] = (sn == w ? 0 : d[sn - 1]);
+        }
+      }
+      start = end;
+    }
+    phrase_saD[isaD[d.size() - 1]] = n_ph;
   }
 
-  
 
   // Serialize to a stream.
   size_type serialize(std::ostream &out, sdsl::structure_tree_node *v = nullptr, std::string name = "") const
@@ -173,12 +229,17 @@ public:
 
     written_bytes += my_serialize(d, out, child, "dictionary");
     written_bytes += my_serialize(saD, out, child, "saD");
-    written_bytes += my_serialize(isaD, out, child, "isaD");
+    written_bytes += isaD.serialize(out, child, "isaD");
     written_bytes += my_serialize(lcpD, out, child, "lcpD");
     written_bytes += rmq_lcp_D.serialize(out, child, "rmq_lcp_D");
     written_bytes += b_d.serialize(out, child, "b_d");
     written_bytes += rank_b_d.serialize(out, child, "rank_b_d");
     written_bytes += select_b_d.serialize(out, child, "select_b_d");
+    written_bytes += phrase_saD.serialize(out, child, "phrase_saD");
+    written_bytes += suffix_length_saD.serialize(out, child, "suffix_length_saD");
+    written_bytes += valid_saD.serialize(out, child, "valid_saD");
+    written_bytes += my_serialize(bwt_char_saD, out, child, "bwt_char_saD");
+    written_bytes += my_serialize(alphabet, out, child, "alphabet");
     sdsl::structure_tree::add_size(child, written_bytes);
     return written_bytes;
 
@@ -189,12 +250,17 @@ public:
   {
     my_load(d, in);
     my_load(saD, in);
-    my_load(isaD, in);
+    isaD.load(in);
     my_load(lcpD, in);
     rmq_lcp_D.load(in);
     b_d.load(in);
     rank_b_d.load(in, &b_d);
     select_b_d.load(in, &b_d);
+    phrase_saD.load(in);
+    suffix_length_saD.load(in);
+    valid_saD.load(in);
+    my_load(bwt_char_saD, in);
+    my_load(alphabet, in);
   }
 };
 
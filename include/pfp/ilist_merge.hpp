@@ -0,0 +1,158 @@
+/* ilist_merge - merging the occurrences of phrases in the BWT of the parse
+    Copyright (C) 2020 Massimiliano Rossi
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file ilist_merge.hpp
+   \brief ilist_merge.hpp define a loser tree merging the ranges of the inverted list of the parse.
+   \author Massimiliano Rossi
+   \date 02/07/2020
+*/
+
+#ifndef _ILIST_MERGE_HH
+#define _ILIST_MERGE_HH
+
+#include <common.hpp>
+
+#include <limits>
+
+// Merges the occurrences in BWT_P of the phrases sharing the same suffix.
+// Each phrase is a sorted range of ilist, the merge returns maximal blocks of
+// consecutive occurrences coming from the same range.
+template <typename ilist_t>
+class ilist_merge{
+public:
+
+    typedef struct
+    {
+        size_t begin;     // Position in ilist of the next occurrence
+        size_t end;       // End of the occurrences in ilist
+        uint8_t bwt_char; // BWT character of the phrase
+    } range_t;
+
+    std::vector<range_t> ranges;
+
+    ilist_merge(const ilist_t &ilist_) : ilist(ilist_) {}
+
+    inline void clear()
+    {
+        ranges.clear();
+    }
+
+    inline void push(size_t begin, size_t end, uint8_t bwt_char)
+    {
+        assert(begin < end);
+        ranges.push_back({begin, end, bwt_char});
+    }
+
+    // Builds the tournament over the ranges pushed since the last clear.
+    void init()
+    {
+        k = 1;
+        while (k < ranges.size())
+            k <<= 1;
+
+        key.assign(k, inf);
+        for (size_t i = 0; i < ranges.size(); ++i)
+            key[i] = ilist[ranges[i].begin];
+
+        // Play the matches bottom-up, each internal node keeps the loser
+        tree.assign(k, 0);
+        winner.resize(2 * k);
+        for (size_t i = 0; i < k; ++i)
+            winner[k + i] = i;
+        for (size_t node = k - 1; node > 0; --node)
+        {
+            size_t l = winner[2 * node];
+            size_t r = winner[2 * node + 1];
+            if (key[r] < key[l])
+                std::swap(l, r);
+            winner[node] = l;
+            tree[node] = r;
+        }
+        tree[0] = winner[1];
+    }
+
+    // Returns in [b, e) the next block of occurrences of range r, false when all ranges are exhausted.
+    inline bool next_block(size_t &r, size_t &b, size_t &e)
+    {
+        r = tree[0];
+        if (key[r] == inf)
+            return false;
+
+        // The runner-up is the smallest loser on the path of the winner
+        size_t second = inf;
+        for (size_t node = (k + r) >> 1; node > 0; node >>= 1)
+            second = std::min(second, key[tree[node]]);
+
+        range_t &range = ranges[r];
+        b = range.begin;
+        e = gallop(b + 1, range.end, second);
+
+        range.begin = e;
+        key[r] = (e < range.end ? ilist[e] : inf);
+        replay(r);
+
+        return true;
+    }
+
+private:
+    const ilist_t &ilist;
+
+    const size_t inf = std::numeric_limits<size_t>::max();
+
+    size_t k = 0;               // Number of leaves, a power of two
+    std::vector<size_t> key;    // Next occurrence of each range
+    std::vector<size_t> tree;   // Losers of the internal nodes, tree[0] is the winner
+    std::vector<size_t> winner; // Winners of the nodes, used only by init
+
+    // First position in [begin, end) whose occurrence is larger than bound
+    inline size_t gallop(size_t begin, size_t end, size_t bound)
+    {
+        size_t lo = begin;
+        size_t step = 1;
+        while (lo < end && ilist[lo] < bound)
+        {
+            lo += step;
+            step <<= 1;
+        }
+        if (lo <= begin)
+            return begin;
+
+        // The answer is in (lo - step/2, min(lo, end)]
+        size_t l = lo - (step >> 1) + 1;
+        size_t r = std::min(lo, end);
+        while (l < r)
+        {
+            size_t m = l + ((r - l) >> 1);
+            if (ilist[m] < bound)
+                l = m + 1;
+            else
+                r = m;
+        }
+        return l;
+    }
+
+    inline void replay(size_t r)
+    {
+        size_t w = r;
+        for (size_t node = (k + r) >> 1; node > 0; node >>= 1)
+            if (key[tree[node]] < key[w])
+                std::swap(tree[node], w);
+        tree[0] = w;
+    }
+};
+
+#endif /* end of include guard: _ILIST_MERGE_HH */
@@ -0,0 +1,320 @@
+/* kr_parser - prefix free parsing of a text in memory
+    Copyright (C) 2020 Massimiliano Rossi
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file kr_parser.hpp
+   \brief kr_parser.hpp computes the prefix-free parsing of a text in memory using Karp-Rabin fingerprints.
+   \author Massimiliano Rossi
+   \date 25/06/2020
+   \note The parsing is the same computed by newscan in https://github.com/alshai/Big-BWT
+*/
+
+#ifndef _KR_PARSER_HH
+#define _KR_PARSER_HH
+
+#include <common.hpp>
+
+#include <algorithm>
+#include <unordered_map>
+
+extern "C" {
+    #include<gsacak.h>
+}
+
+// A phrase ends where the Karp-Rabin fingerprint of the last w characters is 0
+// modulo mod, and two consecutive phrases overlap by w characters. The first phrase
+// starts with a Dollar and the last one ends with w Dollars.
+class kr_parser{
+public:
+  std::vector<uint8_t> d;   // The dictionary, in the format of infile.dict
+  std::vector<uint32_t> p;  // The ranks of the phrases in the dictionary, followed by a 0
+  std::vector<uint_t> freq; // The number of occurrences of each phrase, in the format of infile.occ
+
+  size_t w;   // Size of the window
+  size_t mod; // Modulus of the fingerprints ending a phrase
+
+  kr_parser(std::string filename,
+            size_t w_,
+            size_t mod_,
+            bool is_fasta = false,
+            size_t n_threads_ = 1):
+            w(w_),
+            mod(mod_),
+            n_threads(std::max(n_threads_, size_t(1)))
+  {
+    if(is_fasta)
+    {
+      std::vector<uint8_t> text;
+      read_fasta_file(filename.c_str(), text);
+      build(text.data(), text.size());
+    }
+    else
+    {
+      mapped_file text(filename, true);
+      build((const uint8_t *)text.data(), text.size());
+    }
+  }
+
+  kr_parser(const uint8_t *text,
+            size_t n,
+            size_t w_,
+            size_t mod_,
+            size_t n_threads_ = 1):
+            w(w_),
+            mod(mod_),
+            n_threads(std::max(n_threads_, size_t(1)))
+  {
+    build(text, n);
+  }
+
+private:
+  size_t n_threads;
+
+  static const uint64_t prime = 1999999973; // Prime of the fingerprints of the windows
+
+  typedef struct
+  {
+    const uint8_t *ptr;
+    size_t length;
+  } phrase_t;
+
+  void build(const uint8_t *text, size_t n)
+  {
+    verbose("Computing the phrase boundaries");
+    std::vector<size_t> ends;
+    _elapsed_time(
+      ends = compute_ends(text, n)
+    );
+
+    // The first and last phrases have the extra Dollars, so they are copied
+    std::vector<uint8_t> first(1, Dollar);
+    std::vector<uint8_t> last;
+    std::vector<phrase_t> phrases(ends.size() + 1);
+    {
+      size_t first_end = (ends.empty() ? n : ends[0] + 1);
+      first.insert(first.end(), text, text + first_end);
+      if(ends.empty())
+        first.insert(first.end(), w, Dollar);
+      else
+      {
+        last.assign(text + ends.back() + 1 - w, text + n);
+        last.insert(last.end(), w, Dollar);
+      }
+      for(size_t k = 1; k < ends.size(); ++k)
+        phrases[k] = {text + ends[k - 1] + 1 - w, ends[k] - ends[k - 1] + w};
+      phrases[0] = {first.data(), first.size()};
+      if(!ends.empty())
+        phrases.back() = {last.data(), last.size()};
+    }
+    std::vector<size_t>().swap(ends);
+
+    verbose("Computing the dictionary");
+    std::vector<size_t> rep(phrases.size()); // The first phrase equal to each phrase
+    std::vector<std::pair<size_t, uint_t>> distinct; // The first occurrence and the number of occurrences of each distinct phrase
+    _elapsed_time(
+      {
+        compute_representatives(phrases, rep, distinct);
+
+        parallel_sort(distinct.begin(), distinct.end(), n_threads, [&](const std::pair<size_t, uint_t> &a, const std::pair<size_t, uint_t> &b) {
+          return compare(phrases[a.first], phrases[b.first]) < 0;
+        });
+
+        std::vector<size_t> offsets(distinct.size() + 1, 0);
+        for(size_t i = 0; i < distinct.size(); ++i)
+          offsets[i + 1] = offsets[i] + phrases[distinct[i].first].length + 1;
+        d.resize(offsets.back() + 1);
+        parallel_for(0, distinct.size(), n_threads, [&](size_t b, size_t e, size_t t) {
+          for(size_t i = b; i < e; ++i)
+          {
+            const phrase_t &phrase = phrases[distinct[i].first];
+            memcpy(&d[offsets[i]], phrase.ptr, phrase.length);
+            d[offsets[i] + phrase.length] = EndOfWord;
+          }
+        });
+        d.back() = EndOfDict;
+      }
+    );
+
+    verbose("Computing the parse");
+    _elapsed_time(
+      {
+        // The ranks are 1-based, 0 is the terminator of the parse
+        p.assign(phrases.size() + 1, 0);
+        freq.resize(distinct.size());
+        parallel_for(0, distinct.size(), n_threads, [&](size_t b, size_t e, size_t t) {
+          for(size_t i = b; i < e; ++i)
+          {
+            p[distinct[i].first] = i + 1;
+            freq[i] = distinct[i].second;
+          }
+        });
+        parallel_for(0, phrases.size(), n_threads, [&](size_t b, size_t e, size_t t) {
+          for(size_t k = b; k < e; ++k)
+            if(rep[k] != k)
+              p[k] = p[rep[k]];
+        });
+      }
+    );
+
+    verbose("Number of phrases: ", distinct.size());
+    verbose("Parse length: ", phrases.size());
+  }
+
+  // Returns the positions of the last characters of the phrases but the last one
+  std::vector<size_t> compute_ends(const uint8_t *text, size_t n)
+  {
+    // Contribution of the first character of a window to its fingerprint
+    uint64_t pot = 1;
+    for(size_t i = 1; i < w; ++i)
+      pot = (pot * 256) % prime;
+
+    std::vector<std::vector<size_t>> ends(n_threads);
+    std::vector<size_t> invalid(n_threads, n);
+    parallel_for(0, n, n_threads, [&](size_t b, size_t e, size_t t) {
+      for(size_t i = b; i < e; ++i)
+        if(text[i] <= Dollar)
+        {
+          invalid[t] = i;
+          return;
+        }
+
+      // Windows ending in [b, e), the first window must be complete
+      size_t i = std::max(b, w - 1);
+      if(i >= e)
+        return;
+      uint64_t hash = 0;
+      for(size_t k = i + 1 - w; k <= i; ++k)
+        hash = (256 * hash + text[k]) % prime;
+      while(true)
+      {
+        if(hash % mod == 0)
+          ends[t].push_back(i);
+        if(++i == e)
+          break;
+        hash += prime - (text[i - w] * pot) % prime;
+        hash = (256 * hash + text[i]) % prime;
+      }
+    });
+
+    for(auto i: invalid)
+      if(i < n)
+        error("Invalid character in position ", i, " of the text, the characters 0, 1, and 2 are reserved.");
+
+    std::vector<size_t> res;
+    for(auto &v: ends)
+    {
+      res.insert(res.end(), v.begin(), v.end());
+      std::vector<size_t>().swap(v);
+    }
+    return res;
+  }
+
+  static inline int compare(const phrase_t &a, const phrase_t &b)
+  {
+    int res = memcmp(a.ptr, b.ptr, std::min(a.length, b.length));
+    if(res != 0)
+      return res;
+    return (a.length < b.length ? -1 : (a.length > b.length ? 1 : 0));
+  }
+
+  static inline uint64_t fingerprint(const phrase_t &a)
+  {
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < a.length; ++i)
+      hash = (hash ^ a.ptr[i]) * 1099511628211ULL;
+    return hash;
+  }
+
+  // The phrases are split in n_threads buckets by fingerprint in one parallel pass, then
+  // each thread finds the duplicates among the phrases of its own buckets. Sets rep, and
+  // the first occurrence and number of occurrences of each distinct phrase in distinct.
+  void compute_representatives(const std::vector<phrase_t> &phrases, std::vector<size_t> &rep, std::vector<std::pair<size_t, uint_t>> &distinct)
+  {
+    std::vector<uint64_t> hash(phrases.size());
+    parallel_for(0, phrases.size(), n_threads, [&](size_t b, size_t e, size_t t) {
+      for(size_t k = b; k < e; ++k)
+        hash[k] = fingerprint(phrases[k]);
+    });
+
+    // counts[t][c] is the number of phrases of block t in bucket c, and then the position
+    // in bucket of the next of them. The phrases of a bucket are in increasing order.
+    std::vector<std::vector<size_t>> counts(n_threads, std::vector<size_t>(n_threads, 0));
+    parallel_for(0, phrases.size(), n_threads, [&](size_t b, size_t e, size_t t) {
+      for(size_t k = b; k < e; ++k)
+        counts[t][hash[k] % n_threads]++;
+    });
+
+    std::vector<size_t> bucket_begin(n_threads + 1, 0);
+    for(size_t c = 0; c < n_threads; ++c)
+    {
+      bucket_begin[c + 1] = bucket_begin[c];
+      for(size_t t = 0; t < n_threads; ++t)
+      {
+        size_t count = counts[t][c];
+        counts[t][c] = bucket_begin[c + 1];
+        bucket_begin[c + 1] += count;
+      }
+    }
+
+    std::vector<size_t> bucket(phrases.size());
+    parallel_for(0, phrases.size(), n_threads, [&](size_t b, size_t e, size_t t) {
+      for(size_t k = b; k < e; ++k)
+        bucket[counts[t][hash[k] % n_threads]++] = k;
+    });
+
+    std::vector<std::vector<std::pair<size_t, uint_t>>> bucket_distinct(n_threads);
+    parallel_for(0, n_threads, n_threads, [&](size_t b, size_t e, size_t t) {
+      for(size_t c = b; c < e; ++c)
+      {
+        // Phrases with the same fingerprint are chained through their representatives
+        std::unordered_map<uint64_t, size_t> first; // The position in bucket_distinct[c]
+        for(size_t j = bucket_begin[c]; j < bucket_begin[c + 1]; ++j)
+        {
+          size_t k = bucket[j];
+          uint64_t key = hash[k];
+          while(true)
+          {
+            auto it = first.find(key);
+            if(it == first.end())
+            {
+              first[key] = bucket_distinct[c].size();
+              bucket_distinct[c].push_back({k, 1});
+              rep[k] = k;
+              break;
+            }
+            auto &r = bucket_distinct[c][it->second];
+            if(compare(phrases[r.first], phrases[k]) == 0)
+            {
+              rep[k] = r.first;
+              r.second++;
+              break;
+            }
+            key++; // Collision of the fingerprints
+          }
+        }
+      }
+    });
+
+    distinct.clear();
+    for(auto &v: bucket_distinct)
+    {
+      distinct.insert(distinct.end(), v.begin(), v.end());
+      std::vector<std::pair<size_t, uint_t>>().swap(v);
+    }
+  }
+};
+
+#endif /* end of include guard: _KR_PARSER_HH */
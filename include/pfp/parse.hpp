@@ -29,6 +29,7 @@
 
 #include <sdsl/rmq_support.hpp>
 #include <sdsl/int_vector.hpp>
+#include <malloc_count.h>
 extern "C" {
     #include<gsacak.h>
 }
@@ -38,23 +39,28 @@ class parse{
 public:
   std::vector<uint32_t> p;
   std::vector<uint_t> saP;
-  std::vector<uint_t> isaP;
+  sdsl::int_vector<> isaP;
 
-  std::vector<int_t> ilist; // Inverted list of phrases of P in BWT_P
+  sdsl::int_vector<> ilist; // Inverted list of phrases of P in BWT_P
+  packed_view ilist_view;   // The entries of ilist, in memory or in a mapped file
   sdsl::bit_vector ilist_s; // The ith 1 is in correspondence of the first occurrence of the ith phrase
   sdsl::bit_vector::select_1_type select_ilist_s;
 
   size_t alphabet_size;
+  size_t n_threads = 1; // Number of threads used to build the data structures
 
   typedef size_t size_type;
 
   // Default constructor for load
   parse() {}
 
+  // p_ is terminated by 0, and it is moved in the parse
   parse(  std::vector<uint32_t>& p_,
-          size_t alphabet_size_):
-          p(p_),
-          alphabet_size(alphabet_size_)
+          size_t alphabet_size_,
+          size_t n_threads_ = 1):
+          p(std::move(p_)),
+          alphabet_size(alphabet_size_),
+          n_threads(n_threads_)
   {
     assert(p.back() == 0);
 
@@ -66,8 +72,10 @@ public:
   }
 
   parse(  std::string filename,
-          size_t alphabet_size_):
-          alphabet_size(alphabet_size_)
+          size_t alphabet_size_,
+          size_t n_threads_ = 1):
+          alphabet_size(alphabet_size_),
+          n_threads(n_threads_)
   {
     // Building dictionary from file
     std::string tmp_filename = filename + std::string(".parse");
@@ -93,6 +101,7 @@ public:
     _elapsed_time(
       sacak_int(&p[0],&saP[0],p.size(),alphabet_size);
     );
+    verbose("Memory peak: ", malloc_count_peak());
 
 
 
@@ -101,27 +110,50 @@ public:
     _elapsed_time(
       compute_ilist()
     );
+    verbose("Memory peak: ", malloc_count_peak());
 
 
     // inverse suffix array of the parsing.
     verbose("Computing ISA of the parsing");
     _elapsed_time(
       {
-        isaP.resize(p.size());
-        for(int i = 0; i < saP.size(); ++i){
-          isaP[saP[i]] = i;
-        }
+        isaP = sdsl::int_vector<>(p.size(), 0, width_of(p.size()));
+        parallel_for(0, saP.size(), n_threads, [&](size_t begin, size_t end, size_t t) {
+          if (n_threads > 1)
+            for (size_t i = begin; i < end; ++i)
+              set_packed_concurrent(isaP, saP[i], i);
+          else
+            for (size_t i = begin; i < end; ++i)
+              isaP[saP[i]] = i;
+        });
       }
     );
+    verbose("Memory peak: ", malloc_count_peak());
+
+
+  }
+
+  // Moves ilist to a file mapped in memory.
+  void spill_ilist(std::string filename)
+  {
+    spill_to_file(ilist, filename, ilist_view, ilist_file);
+  }
 
+  inline bool is_ilist_spilled() const { return ilist_file != nullptr; }
 
+  // Reads ilist from a view on file, that is kept mapped as long as the parse.
+  void map_ilist(const packed_view &view, std::shared_ptr<mapped_file> file)
+  {
+    ilist = sdsl::int_vector<>();
+    ilist_view = view;
+    ilist_file = file;
   }
 
 
   void compute_ilist()
   {
 
-    ilist.resize(p.size(),0);
+    ilist = sdsl::int_vector<>(p.size(), 0, width_of(p.size()));
     ilist_s = sdsl::bit_vector(p.size() + 1, 0);
 
     // computing the bucket boundaries
@@ -137,16 +169,57 @@ public:
 
     select_ilist_s = sdsl::bit_vector::select_1_type(&ilist_s);
 
+    auto preceding_phrase = [&](size_t i) {
+      size_t prec_phrase_index = (saP[i] == 0 ? p.size() : saP[i]) - 1;
+      return p[prec_phrase_index];
+    };
+
+    // The offsets of the threads take at most as much memory as ilist
+    size_t max_threads = ilist.bit_size() / (freq.size() * sizeof(uint_t) * 8);
+    size_t threads = std::max(size_t(1), std::min(n_threads, max_threads));
 
-    for(size_t i = 0; i < saP.size(); ++i)
+    if (threads <= 1)
     {
-      size_t prec_phrase_index = (saP[i] == 0 ? p.size() : saP[i]) - 1;
-      uint_t prec_phrase = p[prec_phrase_index];
+      for(size_t i = 0; i < saP.size(); ++i)
+      {
+        uint_t prec_phrase = preceding_phrase(i);
 
-      size_t ilist_p = select_ilist_s(prec_phrase + 1) + freq[prec_phrase]++;
-      ilist[ilist_p] = i;
+        size_t ilist_p = select_ilist_s(prec_phrase + 1) + freq[prec_phrase]++;
+        ilist[ilist_p] = i;
+      }
+    }
+    else
+    {
+      // Each thread fills the ilist entries of a block of saP. The entries of a phrase
+      // in block t follow the ones in the blocks before t.
+      std::vector<std::vector<uint_t>> offsets(threads, std::vector<uint_t>(freq.size(), 0));
+
+      parallel_for(0, saP.size(), threads, [&](size_t begin, size_t end, size_t t) {
+        for (size_t i = begin; i < end; ++i)
+          offsets[t][preceding_phrase(i)]++;
+      });
+
+      parallel_for(0, freq.size(), threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t phrase = begin; phrase < end; ++phrase)
+        {
+          size_t offset = select_ilist_s(phrase + 1);
+          for (size_t t = 0; t < threads; ++t)
+          {
+            uint_t count = offsets[t][phrase];
+            offsets[t][phrase] = offset;
+            offset += count;
+          }
+        }
+      });
+
+      parallel_for(0, saP.size(), threads, [&](size_t begin, size_t end, size_t t) {
+        for (size_t i = begin; i < end; ++i)
+          set_packed_concurrent(ilist, offsets[t][preceding_phrase(i)]++, i);
+      });
     }
 
+    set_views();
+
     freq.clear();
     freq.shrink_to_fit();
   }
@@ -163,16 +236,22 @@ public:
 
   }
 
-  // Serialize to a stream.
-  size_type serialize(std::ostream &out, sdsl::structure_tree_node *v = nullptr, std::string name = "") const
+  // Serialize to a stream. Without ilist_, ilist is left to the caller.
+  size_type serialize(std::ostream &out, sdsl::structure_tree_node *v = nullptr, std::string name = "", bool ilist_ = true) const
   {
     sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
     size_type written_bytes = 0;
 
     written_bytes += my_serialize(p, out, child, "parse");
     written_bytes += my_serialize(saP, out, child, "saP");
-    written_bytes += my_serialize(isaP, out, child, "isaP");
-    written_bytes += my_serialize(ilist, out, child, "ilist");
+    written_bytes += isaP.serialize(out, child, "isaP");
+    if (ilist_)
+    {
+      if (is_ilist_spilled())
+        written_bytes += to_int_vector(ilist_view).serialize(out, child, "ilist");
+      else
+        written_bytes += ilist.serialize(out, child, "ilist");
+    }
     written_bytes += ilist_s.serialize(out, child, "ilist_s");
     written_bytes += select_ilist_s.serialize(out, child, "select_ilist_s");
     written_bytes += sdsl::write_member(alphabet_size, out, child, "alphabet_size");
@@ -182,20 +261,29 @@ public:
     return written_bytes;
   }
 
-  //! Load from a stream.
-  void load(std::istream &in)
+  //! Load from a stream. Without ilist_, ilist has to be set with map_ilist.
+  void load(std::istream &in, bool ilist_ = true)
   {
     my_load(p, in);
     my_load(saP, in);
-    my_load(isaP, in);
-    my_load(ilist, in);
+    isaP.load(in);
+    if (ilist_)
+      ilist.load(in);
+    ilist_file.reset();
+    set_views();
     ilist_s.load(in);
-    select_ilist_s.load(in);
+    select_ilist_s.load(in, &ilist_s);
     sdsl::read_member(alphabet_size, in);
   }
 
 private:
   std::vector<uint_t> freq;
+  std::shared_ptr<mapped_file> ilist_file; // The file holding ilist, if not in memory
+
+  void set_views()
+  {
+    ilist_view = packed_view(ilist.data(), ilist.size(), ilist.width());
+  }
 };
 
 #endif /* end of include guard: _PFP_PARSE_HH */
@@ -30,6 +30,8 @@
 #include <sdsl/rmq_support.hpp>
 #include <sdsl/int_vector.hpp>
 #include <sdsl/io.hpp>
+
+#include <malloc_count.h>
 extern "C" {
     #include<gsacak.h>
 }
@@ -46,10 +48,15 @@ public:
   size_t n; // Size of the text
   size_t w; // Size of the window
 
-  std::vector<size_t> s_lcp_T; // LCP array of T sampled in corrispondence of the beginning of each phrase.
-  sdsl::rmq_succinct_sct<> rmq_s_lcp_T;
+  sdsl::int_vector<> s_lcp_T; // LCP array of T sampled in corrispondence of the beginning of each phrase.
+  packed_view s_lcp_T_view;   // The entries of s_lcp_T, in memory or in a mapped file
+  block_rmq rmq_s_lcp_T; // Returns the minimum value of s_lcp_T in a range
   
-  std::vector<size_t> pos_T; // for each suffix of P we store the starting posiion of that suffix in T.
+  sdsl::int_vector<> pos_T; // for each suffix of P we store the starting posiion of that suffix in T.
+  packed_view pos_T_view;   // The entries of pos_T, in memory or in a mapped file
+
+  size_t memory_budget = 0; // Bytes available for the arrays of the size of the parse, 0 for no limit
+  bool compare_rmq = false; // Report the size of rmq_succinct_sct on s_lcp_T next to the one of block_rmq
 
   // std::vector<int_t>  ilist;            // Inverted list of phrases of P in BWT_P
   // sdsl::bit_vector ilist_s; // The ith 1 is in correspondence of the first occurrence of the ith phrase
@@ -64,55 +71,146 @@ public:
   // Default constructor for load
   pf_parsing() {}
 
+  // d_ and p_ are in the format of infile.dict and infile.parse, with p_ terminated by 0.
+  // They are moved in the data structure.
+  // When the arrays do not fit in memory_budget_, ilist is moved and s_lcp_T and pos_T
+  // are written to files named after tmp_prefix_, that are deleted as soon as they are mapped.
+  // With compare_rmq_, an rmq_succinct_sct is built on s_lcp_T only to report its size.
   pf_parsing(std::vector<uint8_t> &d_,
              std::vector<uint32_t> &p_,
              std::vector<uint_t> &freq_,
-             size_t w_) : 
+             size_t w_,
+             size_t n_threads_ = 1,
+             size_t memory_budget_ = 0,
+             std::string tmp_prefix_ = "pfp",
+             bool compare_rmq_ = false) : 
             dict(d_, w_),
-            pars(p_, dict.n_phrases() + 1),
+            pars(p_, dict.n_phrases() + 1, n_threads_),
             // freq(freq_),
             s_lcp_T(1,0),
             pos_T(1,0),
             // ilist(pars.p.size()),
             // ilist_s(pars.p.size()+ 1, 0),
-            w(w_)
+            w(w_),
+            memory_budget(memory_budget_),
+            compare_rmq(compare_rmq_),
+            tmp_prefix(tmp_prefix_)
   {
-    // Compute the length of the string;
-    compute_n();
-
-    // verbose("Computing b_p");
-    // _elapsed_time(compute_b_p());
-
-    // Clear unnecessary elements
-    clear_unnecessary_elements();
+    build();
   }
 
-  pf_parsing( std::string filename, size_t w_):
+  pf_parsing( std::string filename, size_t w_, size_t n_threads_ = 1, size_t memory_budget_ = 0, bool compare_rmq_ = false):
               dict(filename, w_),
-              pars(filename,dict.n_phrases()+1),
+              pars(filename,dict.n_phrases()+1, n_threads_),
               // freq(),
               s_lcp_T(1,0),
               pos_T(1,0),
               // ilist(pars.p.size()),
               // ilist_s(pars.p.size()+ 1, 0),
-              w(w_)
+              w(w_),
+              memory_budget(memory_budget_),
+              compare_rmq(compare_rmq_),
+              tmp_prefix(filename)
   {
+    build();
+  }
 
+  void build()
+  {
     // Compute the length of the string;
     compute_n();
 
-    verbose("Computing pos_T");
-    _elapsed_time(compute_pos_T());
+    const size_t m = pars.p.size();
+
+    // ilist, s_lcp_T and pos_T are read only by the scan of saD. When the arrays of the
+    // parse do not fit in the budget, ilist is moved to disk, and s_lcp_T and pos_T are
+    // computed in a single pass each and distributed to blocks on disk that fit in what
+    // is left of the budget by p, saP and isaP, so they are never whole in memory.
+    // p, saP and isaP stay in memory, and the scan reads the spilled arrays at random.
+    const bool spill = (memory_budget > 0 and peak_bytes() > memory_budget);
+    if (spill)
+    {
+      verbose("Estimated peak of ", peak_bytes(), " bytes exceeds the budget of ", memory_budget, " bytes");
 
+      // p, saP, isaP and ilist were all in memory while the parse was built
+      const size_t parse_bytes = resident_bytes(true) + sdsl::size_in_bytes(pars.ilist);
+      if (parse_bytes > memory_budget)
+        warning("The arrays of the parse took ", parse_bytes, " bytes while it was built, more than the memory budget of ",
+                memory_budget, " bytes");
+
+      verbose("Moving ilist to disk");
+      _elapsed_time(pars.spill_ilist(tmp_filename(".ilist")));
+    }
+
+    // Each array of the parse is released as soon as it is no longer needed,
+    // so that at most five arrays of the size of the parse are alive at once.
     verbose("Computing s_lcp_T");
-    _elapsed_time(compute_s_lcp_T());
+    if (spill)
+    {
+      const size_t block_size = spill_block_size(resident_bytes(true));
+      verbose("Writing s_lcp_T to disk in ", (m + block_size - 1) / block_size, " blocks of ", block_size, " entries");
+      _elapsed_time(
+        {
+          block_writer out(tmp_filename(".s_lcp_T"), m, width_of(n), block_size, pars.n_threads);
+          compute_s_lcp_T([&](size_t t, size_t k, uint64_t value) { out.set(t, k, value); });
+          out.finish(s_lcp_T_view, s_lcp_T_file);
+        });
+      s_lcp_T = sdsl::int_vector<>();
+    }
+    else
+    {
+      _elapsed_time(
+        {
+          s_lcp_T = sdsl::int_vector<>(m, 0, width_of(n));
+          compute_s_lcp_T([&](size_t t, size_t k, uint64_t value) {
+            if (pars.n_threads > 1)
+              set_packed_concurrent(s_lcp_T, k, value);
+            else
+              s_lcp_T[k] = value;
+          });
+          s_lcp_T_view = packed_view(s_lcp_T.data(), s_lcp_T.size(), s_lcp_T.width());
+        });
+    }
+    verbose("Memory peak: ", malloc_count_peak());
 
-    print_sizes();
+    // saP is not needed by pos_T
+    pars.saP.clear();
+    pars.saP.shrink_to_fit();
+
+    verbose("Computing pos_T");
+    if (spill)
+    {
+      const size_t block_size = spill_block_size(resident_bytes(false));
+      verbose("Writing pos_T to disk in ", (m + block_size - 1) / block_size, " blocks of ", block_size, " entries");
+      _elapsed_time(
+        {
+          block_writer out(tmp_filename(".pos_T"), m, width_of(n), block_size, 1);
+          compute_pos_T([&](size_t k, uint64_t value) { out.set(0, k, value); });
+          out.finish(pos_T_view, pos_T_file);
+        });
+      pos_T = sdsl::int_vector<>();
+    }
+    else
+    {
+      _elapsed_time(
+        {
+          pos_T = sdsl::int_vector<>(m, 0, width_of(n));
+          compute_pos_T([&](size_t k, uint64_t value) { pos_T[k] = value; });
+          pos_T_view = packed_view(pos_T.data(), pos_T.size(), pos_T.width());
+        });
+    }
+    verbose("Memory peak: ", malloc_count_peak());
 
     print_stats();
 
     // Clear unnecessary elements
     clear_unnecessary_elements();
+
+    verbose("Computing RMQ of s_lcp_T");
+    _elapsed_time(compute_rmq_s_lcp_T());
+    verbose("Memory peak: ", malloc_count_peak());
+
+    print_sizes();
   }
 
   void print_sizes()
@@ -121,16 +219,16 @@ public:
     verbose("Parse");
     verbose("Size of pars.p: ", pars.p.size() * sizeof(pars.p[0]));
     verbose("Size of pars.saP: ", pars.saP.size() * sizeof(pars.saP[0]));
-    verbose("Size of pars.isaP: ", pars.isaP.size() * sizeof(pars.isaP[0]));
+    verbose("Size of pars.isaP: ", sdsl::size_in_bytes(pars.isaP));
 
-    verbose("Size of pars.ilist: ", pars.ilist.size() * sizeof(pars.ilist[0]));
+    verbose("Size of pars.ilist: ", sdsl::size_in_bytes(pars.ilist), (pars.is_ilist_spilled() ? " (on disk)" : ""));
     verbose("Size of pars.ilist_s: ", sdsl::size_in_bytes(pars.ilist_s));
     verbose("Size of pars.select_ilist_s: ", sdsl::size_in_bytes(pars.select_ilist_s));
 
     verbose("Dictionary");
     verbose("Size of dict.d: ", dict.d.size() * sizeof(dict.d[0]));
     verbose("Size of dict.saD: ", dict.saD.size() * sizeof(dict.saD[0]));
-    verbose("Size of dict.isaD: ", dict.isaD.size() * sizeof(dict.isaD[0]));
+    verbose("Size of dict.isaD: ", sdsl::size_in_bytes(dict.isaD));
     verbose("Size of dict.lcpD: ", dict.lcpD.size() * sizeof(dict.lcpD[0]));
     verbose("Size of dict.rmq_lcp_D: ", sdsl::size_in_bytes(dict.rmq_lcp_D));
 
@@ -138,10 +236,26 @@ public:
     verbose("Size of dict.rank_b_d: ", sdsl::size_in_bytes(dict.rank_b_d));
     verbose("Size of dict.select_b_d: ", sdsl::size_in_bytes(dict.select_b_d));
 
+    verbose("Size of dict.phrase_saD: ", sdsl::size_in_bytes(dict.phrase_saD));
+    verbose("Size of dict.suffix_length_saD: ", sdsl::size_in_bytes(dict.suffix_length_saD));
+    verbose("Size of dict.valid_saD: ", sdsl::size_in_bytes(dict.valid_saD));
+    verbose("Size of dict.bwt_char_saD: ", dict.bwt_char_saD.size() * sizeof(dict.bwt_char_saD[0]));
+
     verbose("PFP");
-    verbose("Size of s_lcp_T: ", s_lcp_T.size() * sizeof(s_lcp_T[0]));
-    verbose("Size of rmq_s_lcp_T: ", sdsl::size_in_bytes(rmq_s_lcp_T));
-    verbose("Size of pos_T: ", pos_T.size() * sizeof(pos_T[0]));
+    verbose("Size of s_lcp_T: ", sdsl::size_in_bytes(s_lcp_T), " (", s_lcp_T_view.size() * sizeof(size_t), " as std::vector<size_t>)",
+            (s_lcp_T_file != nullptr ? " (on disk)" : ""));
+    verbose("Size of rmq_s_lcp_T: ", sdsl::size_in_bytes(rmq_s_lcp_T),
+            " (", 8.0 * sdsl::size_in_bytes(rmq_s_lcp_T) / std::max(s_lcp_T_view.size(), size_t(1)), " bits per entry)");
+    // The rmq_succinct_sct previously used on s_lcp_T needs s_lcp_T in memory
+    if (compare_rmq and s_lcp_T_file != nullptr)
+      verbose("Size of rmq_succinct_sct on s_lcp_T: not computed, s_lcp_T is on disk");
+    else if (compare_rmq)
+    {
+      sdsl::rmq_succinct_sct<> rmq(&s_lcp_T);
+      verbose("Size of rmq_succinct_sct on s_lcp_T: ", sdsl::size_in_bytes(rmq),
+              " (", 8.0 * sdsl::size_in_bytes(rmq) / std::max(s_lcp_T.size(), size_t(1)), " bits per entry)");
+    }
+    verbose("Size of pos_T: ", sdsl::size_in_bytes(pos_T), (pos_T_file != nullptr ? " (on disk)" : ""));
 
   }
 
@@ -168,22 +282,19 @@ public:
     //n += w - 1; // Changed after changind b_d in dict // -1 is for the first dollar + w because n is the length including the last w markers
   }
 
-  void compute_pos_T(){
-    std::vector<size_t> poss(pars.p.size(),0);
-    for (size_t j = 1; j < pars.p.size(); ++j)
-    {
-      poss[j] = poss[j-1] + dict.length_of_phrase(pars.p[j-1]) - w;
-    }
-
-    pos_T.resize(pars.p.size(), 0);
+  // Scans P in text order and stores the starting position of each suffix in pos_T through isaP,
+  // without an array of the positions of the phrases in T.
+  // Each entry k of pos_T is passed to store(k, value).
+  template <typename F>
+  void compute_pos_T(F store)
+  {
+    size_t pos = 0;
     for (size_t j = 0; j < pars.p.size(); ++j)
     {
-      size_t pos = poss[pars.saP[j]];
-      if(pos == 0)
-        pos = n; // - w;
-      pos_T[j] = pos;
+      store(pars.isaP[j], (pos == 0 ? n : pos)); // - w;
+      if (j + 1 < pars.p.size())
+        pos += dict.length_of_phrase(pars.p[j]) - w;
     }
-
   }
 
   // Return the frequency of the phrase
@@ -194,46 +305,92 @@ public:
   }
 
   // Customized Kasai et al.
-  void compute_s_lcp_T()
+  // The suffixes of P are split in blocks that are processed in parallel. Each block
+  // starts from l = 0, that is a valid lower bound of the lcp of its first suffix.
+  // Each entry k of s_lcp_T is passed to store(t, k, value) from the t-th thread.
+  template <typename F>
+  void compute_s_lcp_T(F store)
   {
     size_t n = pars.saP.size();
-    s_lcp_T.resize(n, 0);
 
-    size_t l = 0;
-    size_t lt = 0;
-    for (size_t i = 0; i < n; ++i)
-    {
-      // if i is the last character LCP is not defined
-      size_t k = pars.isaP[i];
-      if (k > 0)
+    parallel_for(0, n, pars.n_threads, [&](size_t begin, size_t end, size_t t) {
+      phrase_lcp_cache lcp_cache(dict);
+
+      size_t l = 0;
+      size_t lt = 0;
+      for (size_t i = begin; i < end; ++i)
       {
-        size_t j = pars.saP[k - 1];
-        // I find the longest common prefix of the i-th suffix and the j-th suffix.
-        while (pars.p[i + l] == pars.p[j + l])
+        // if i is the last character LCP is not defined
+        size_t k = pars.isaP[i];
+        if (k > 0)
         {
-          lt += dict.length_of_phrase(pars.p[i + l]) - w; // I remove the last w overlapping characters
-          l++;
-        }
-        size_t lcpp = dict.longest_common_phrase_prefix(pars.p[i + l], pars.p[j + l]);
+          size_t j = pars.saP[k - 1];
+          // I find the longest common prefix of the i-th suffix and the j-th suffix.
+          while (pars.p[i + l] == pars.p[j + l])
+          {
+            lt += dict.length_of_phrase(pars.p[i + l]) - w; // I remove the last w overlapping characters
+            l++;
+          }
+          size_t lcpp = lcp_cache(pars.p[i + l], pars.p[j + l]);
+
+          // l stores the length of the longest common prefix between the i-th suffix and the j-th suffix
+          store(t, k, lt + lcpp);
+          if (l > 0)
+          {
+            l--;
+            lt -= dict.length_of_phrase(pars.p[i]) - w; // I have to remove the length of the first matching phrase
+          }
 
-        // l stores the length of the longest common prefix between the i-th suffix and the j-th suffix
-        s_lcp_T[k] = lt + lcpp;
-        if (l > 0)
-        {
-          l--;
-          lt -= dict.length_of_phrase(pars.p[i]) - w; // I have to remove the length of the first matching phrase
         }
-
       }
-    }
+    });
+  }
 
-    rmq_s_lcp_T = sdsl::rmq_succinct_sct<>(&s_lcp_T);
+  void compute_rmq_s_lcp_T()
+  {
+    rmq_s_lcp_T = block_rmq(s_lcp_T_view);
+  }
+
+  // Bytes of the arrays of the size of the parse alive while s_lcp_T is computed
+  // in memory
+  size_t peak_bytes() const
+  {
+    const size_t m = pars.p.size();
+    return m * (sizeof(pars.p[0]) + sizeof(uint_t)) +
+           sdsl::size_in_bytes(pars.isaP) +
+           sdsl::size_in_bytes(pars.ilist) +
+           ((m * width_of(n) + 63) >> 6) * sizeof(uint64_t);
+  }
+
+  // Bytes of the arrays of the parse that stay in memory while s_lcp_T (with saP)
+  // or pos_T (without saP) are computed
+  size_t resident_bytes(bool with_saP) const
+  {
+    const size_t m = pars.p.size();
+    return m * (sizeof(pars.p[0]) + (with_saP ? sizeof(uint_t) : 0)) +
+           sdsl::size_in_bytes(pars.isaP);
+  }
+
+  // Number of entries of s_lcp_T or pos_T in each block on disk, so that the block, or
+  // the buffers that distribute the entries to the blocks, and the resident arrays fit
+  // in the budget. When the resident arrays alone take
+  // most of the budget, the blocks are of 1 MiB and the budget is exceeded.
+  size_t spill_block_size(size_t resident) const
+  {
+    const size_t min_bytes = 1ULL << 20;
+    size_t bytes = (memory_budget > resident ? memory_budget - resident : 0);
+    if (bytes < min_bytes)
+    {
+      warning("The arrays of the parse kept in memory take ", resident, " bytes, the memory budget of ",
+              memory_budget, " bytes cannot be met");
+      bytes = min_bytes;
+    }
+    return std::max(size_t(64), bytes * 8 / width_of(n) / 64 * 64);
   }
 
   void clear_unnecessary_elements(){
     // Reducing memory tentative
-    pars.isaP.clear(); 
-    pars.isaP.shrink_to_fit();
+    pars.isaP = sdsl::int_vector<>();
 
     pars.saP.clear(); 
     pars.saP.shrink_to_fit();
@@ -251,8 +408,15 @@ public:
 
     written_bytes += dict.serialize(out, child, "dictionary");
     written_bytes += pars.serialize(out, child, "parse");
-    written_bytes += my_serialize(s_lcp_T, out, child, "s_lcp_T");
+    if (s_lcp_T_file != nullptr)
+      written_bytes += to_int_vector(s_lcp_T_view).serialize(out, child, "s_lcp_T");
+    else
+      written_bytes += s_lcp_T.serialize(out, child, "s_lcp_T");
     written_bytes += rmq_s_lcp_T.serialize(out, child, "rmq_s_lcp_T");
+    if (pos_T_file != nullptr)
+      written_bytes += to_int_vector(pos_T_view).serialize(out, child, "pos_T");
+    else
+      written_bytes += pos_T.serialize(out, child, "pos_T");
     written_bytes += sdsl::write_member(n, out, child, "n");
     written_bytes += sdsl::write_member(w, out, child, "w");
 
@@ -265,17 +429,196 @@ public:
   {
     dict.load(in);
     pars.load(in);
-    my_load(s_lcp_T, in);
-    rmq_s_lcp_T.load(in);
+    s_lcp_T.load(in);
+    s_lcp_T_file.reset();
+    s_lcp_T_view = packed_view(s_lcp_T.data(), s_lcp_T.size(), s_lcp_T.width());
+    rmq_s_lcp_T.load(in, s_lcp_T_view);
+    pos_T.load(in);
+    pos_T_file.reset();
+    pos_T_view = packed_view(pos_T.data(), pos_T.size(), pos_T.width());
     sdsl::read_member(n, in);
     sdsl::read_member(w, in);
   }
 
+  // Serialize in the memory-mappable layout of load_mapped(): a header followed by
+  // the other data structures, and by ilist, s_lcp_T and pos_T in aligned sections.
+  size_type serialize_mapped(std::ostream &out) const
+  {
+    std::stringstream base_ss;
+    dict.serialize(base_ss);
+    pars.serialize(base_ss, nullptr, "", false);
+    rmq_s_lcp_T.serialize(base_ss);
+    std::string base_s = base_ss.str();
+
+    header_t header;
+    header.n = n;
+    header.w = w;
+
+    size_t offset = align_section(sizeof(header_t));
+    auto add_section = [&](section_id id, size_t bytes, size_t size, size_t width) {
+      header.sections[id] = {offset, bytes, size, width};
+      offset = align_section(offset + bytes);
+    };
+    add_section(BASE_SECTION, base_s.size(), base_s.size(), 8);
+    add_section(ILIST_SECTION, pars.ilist_view.bytes(), pars.ilist_view.size(), pars.ilist_view.width());
+    add_section(S_LCP_T_SECTION, s_lcp_T_view.bytes(), s_lcp_T_view.size(), s_lcp_T_view.width());
+    add_section(POS_T_SECTION, pos_T_view.bytes(), pos_T_view.size(), pos_T_view.width());
+
+    size_type written_bytes = 0;
+    auto write_section = [&](const char *data, size_t bytes) {
+      // Pad up to the beginning of the section
+      const char zeros[PFP_SECTION_ALIGNMENT] = {0};
+      out.write(zeros, align_section(written_bytes) - written_bytes);
+      written_bytes = align_section(written_bytes);
+
+      out.write(data, bytes);
+      written_bytes += bytes;
+    };
+    write_section((const char *)&header, sizeof(header_t));
+    write_section(base_s.data(), base_s.size());
+    write_section((const char *)pars.ilist_view.words(), pars.ilist_view.bytes());
+    write_section((const char *)s_lcp_T_view.words(), s_lcp_T_view.bytes());
+    write_section((const char *)pos_T_view.words(), pos_T_view.bytes());
+
+    return written_bytes;
+  }
+
+  // Maps a structure serialized with serialize_mapped(). ilist, s_lcp_T and pos_T
+  // are read in place from the mapping, the other data structures are loaded.
+  // Returns false, leaving the structure unchanged, if the header of the file is invalid
+  // or its sections do not fit in the file.
+  bool load_mapped(std::string filename)
+  {
+    auto mapping = std::make_shared<mapped_file>(filename);
+    const char *base = mapping->data();
+
+    if (mapping->size() < sizeof(header_t))
+      return false;
+
+    const header_t *header = (const header_t *)base;
+    if (header->magic != PFP_MAGIC)
+      return false;
+    for (size_t i = 0; i < N_SECTIONS; ++i)
+      if (header->sections[i].offset + header->sections[i].bytes > mapping->size())
+        return false;
+
+    n = header->n;
+    w = header->w;
+
+    const section_t &base_section = header->sections[BASE_SECTION];
+    memory_streambuf base_buf(base + base_section.offset, base_section.bytes);
+    std::istream base_in(&base_buf);
+    dict.load(base_in);
+    pars.load(base_in, false);
+    pars.map_ilist(section_view(mapping, header->sections[ILIST_SECTION]), mapping);
+
+    s_lcp_T = sdsl::int_vector<>();
+    s_lcp_T_view = section_view(mapping, header->sections[S_LCP_T_SECTION]);
+    s_lcp_T_file = mapping;
+    rmq_s_lcp_T.load(base_in, s_lcp_T_view);
+
+    pos_T = sdsl::int_vector<>();
+    pos_T_view = section_view(mapping, header->sections[POS_T_SECTION]);
+    pos_T_file = mapping;
+
+    return true;
+  }
+
   std::string filesuffix() const
   {
     return ".pf.ds.thr";
   }
 
+private:
+  // Layout of the memory-mappable file: a header followed by aligned sections
+  static const uint64_t PFP_MAGIC = 0x3130305344504650ULL; // "PFPDS001"
+  static const size_t PFP_SECTION_ALIGNMENT = 64;
+
+  enum section_id
+  {
+    BASE_SECTION,
+    ILIST_SECTION,
+    S_LCP_T_SECTION,
+    POS_T_SECTION,
+    N_SECTIONS
+  };
+
+  typedef struct
+  {
+    uint64_t offset; // Offset of the section from the beginning of the file
+    uint64_t bytes;  // Size of the section in bytes
+    uint64_t size;   // Number of elements
+    uint64_t width;  // Width in bits of the elements
+  } section_t;
+
+  typedef struct
+  {
+    uint64_t magic = PFP_MAGIC;
+    uint64_t n = 0;
+    uint64_t w = 0;
+    section_t sections[N_SECTIONS];
+  } header_t;
+
+  static inline size_t align_section(size_t offset)
+  {
+    return (offset + PFP_SECTION_ALIGNMENT - 1) / PFP_SECTION_ALIGNMENT * PFP_SECTION_ALIGNMENT;
+  }
+
+  static inline packed_view section_view(const std::shared_ptr<mapped_file> &mapping, const section_t &section)
+  {
+    return packed_view((const uint64_t *)(mapping->data() + section.offset), section.size, section.width);
+  }
+
+  std::string tmp_prefix; // Prefix of the files of the arrays moved to disk
+  std::shared_ptr<mapped_file> s_lcp_T_file; // The file holding s_lcp_T, if not in memory
+  std::shared_ptr<mapped_file> pos_T_file;   // The file holding pos_T, if not in memory
+
+  std::string tmp_filename(std::string suffix) const
+  {
+    return tmp_prefix + "." + std::to_string(getpid()) + suffix + ".tmp";
+  }
+
+  // Direct-mapped cache of the lcp of pairs of phrases. The same pairs of mismatching
+  // phrases occur many times in the parse of a repetitive text.
+  class phrase_lcp_cache
+  {
+  public:
+    phrase_lcp_cache(dictionary &dict_, size_t bits = 16) : dict(dict_),
+                                                            shift(64 - bits),
+                                                            entries(1ULL << bits)
+    {
+    }
+
+    inline size_t operator()(size_t a, size_t b)
+    {
+      if (a > b)
+        std::swap(a, b);
+      if (a == 0)
+        return 0;
+
+      entry_t &e = entries[(((a * 0x9E3779B97F4A7C15ULL) ^ b) * 0xBF58476D1CE4E5B9ULL) >> shift];
+      if (e.a != a || e.b != b)
+      {
+        e.a = a;
+        e.b = b;
+        e.lcp = dict.longest_common_phrase_prefix(a, b);
+      }
+      return e.lcp;
+    }
+
+  private:
+    typedef struct
+    {
+      size_t a = 0;
+      size_t b = 0;
+      size_t lcp = 0;
+    } entry_t;
+
+    dictionary &dict;
+    const size_t shift;
+    std::vector<entry_t> entries;
+  };
+
 
 };
 
@@ -0,0 +1,229 @@
+/* pfp_lce - longest common extensions with Karp-Rabin fingerprints on the prefix-free parsing
+    Copyright (C) 2020 Massimiliano Rossi
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file pfp_lce.hpp
+   \brief pfp_lce.hpp computes the length of the match of a pattern with the text using Karp-Rabin fingerprints on the prefix-free parsing.
+   \author Massimiliano Rossi
+   \date 13/07/2020
+*/
+
+#ifndef _PFP_LCE_HH
+#define _PFP_LCE_HH
+
+#include <common.hpp>
+
+#include <algorithm>
+
+#include <pfp_ra.hpp>
+
+// The fingerprint of a string s is the sum of s[k] * base^(|s| - 1 - k) modulo
+// 2^61 - 1. The fingerprint of each prefix of the text ending at a phrase boundary is
+// sampled, and the fingerprint of each prefix of each phrase is stored with the
+// dictionary, so the fingerprint of any substring of the text takes a constant number
+// of accesses to ra. Two strings with the same fingerprint are considered equal, which
+// is wrong with probability about length / 2^61.
+template <typename ra_t = pfp_ra>
+class pfp_lce
+{
+public:
+  const ra_t &ra;
+
+  // The prefixes of a pattern with their fingerprints
+  class query
+  {
+  public:
+    query(const uint8_t *data_, size_t m) : data(data_), prefix(m + 1, 0)
+    {
+      for (size_t i = 0; i < m; ++i)
+        prefix[i + 1] = extend(prefix[i], data[i]);
+    }
+
+    inline size_t size() const { return prefix.size() - 1; }
+
+  private:
+    friend class pfp_lce;
+
+    const uint8_t *data;
+    std::vector<uint64_t> prefix; // prefix[i] is the fingerprint of data[0, i)
+  };
+
+  pfp_lce(const ra_t &ra_) : ra(ra_)
+  {
+    verbose("Computing the fingerprints of the phrases");
+    _elapsed_time(build_phrase_prefix());
+
+    verbose("Computing the fingerprints of the text at the phrase boundaries");
+    _elapsed_time(build_text_prefix());
+  }
+
+  // Length of the longest common prefix of pattern[i, m) and the text starting in pos,
+  // that stops at the end of the text. The first direct characters are compared
+  // directly, longer matches are found with an exponential and a binary search on
+  // the fingerprints.
+  size_t match_length(uint64_t pos, const query &pattern, size_t i) const
+  {
+    if (pos >= ra.n)
+      return 0;
+    size_t len = std::min(pattern.size() - i, size_t(ra.n - pos));
+
+    size_t first = std::min(len, size_t(direct));
+    size_t l = ra.match_length(pos, pattern.data + i, first);
+    if (l < first)
+      return l;
+
+    // The first lo characters match, and if hi < len the first hi do not
+    size_t lo = l, hi = len;
+    while (lo < len)
+    {
+      size_t mid = std::min(len, 2 * lo);
+      if (!equal(pos, pattern, i, mid))
+      {
+        hi = mid;
+        break;
+      }
+      lo = mid;
+    }
+    while (hi - lo > direct)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (equal(pos, pattern, i, mid))
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+    return lo + ra.match_length(pos + lo, pattern.data + i + lo, hi - lo);
+  }
+
+  size_t size_in_bytes() const
+  {
+    return (phrase_prefix.size() + text_prefix.size() + power.size()) * sizeof(uint64_t);
+  }
+
+private:
+  static const uint64_t prime = (uint64_t(1) << 61) - 1;
+  static const uint64_t base = 0x1f3d5b79a2c4e687ULL % ((uint64_t(1) << 61) - 1);
+  static const size_t direct = 256; // Matches up to this length are found without fingerprints
+
+  std::vector<uint64_t> phrase_prefix; // Fingerprint of the prefix of the phrase ending at each position of d
+  std::vector<uint64_t> text_prefix;   // Fingerprint of the prefix of the text ending at each phrase boundary
+  std::vector<uint64_t> power;         // base^k for k up to the length of the longest phrase
+
+  static inline uint64_t mul(uint64_t a, uint64_t b)
+  {
+    __uint128_t x = (__uint128_t)a * b;
+    uint64_t res = (uint64_t)(x & prime) + (uint64_t)(x >> 61);
+    return (res >= prime ? res - prime : res);
+  }
+
+  static inline uint64_t add(uint64_t a, uint64_t b)
+  {
+    uint64_t res = a + b;
+    return (res >= prime ? res - prime : res);
+  }
+
+  static inline uint64_t sub(uint64_t a, uint64_t b)
+  {
+    return (a >= b ? a - b : a + prime - b);
+  }
+
+  static inline uint64_t extend(uint64_t h, uint8_t c)
+  {
+    return add(mul(h, base), c);
+  }
+
+  inline uint64_t pow(size_t k) const
+  {
+    if (k < power.size())
+      return power[k];
+    uint64_t res = 1, b = base;
+    for (; k > 0; k >>= 1, b = mul(b, b))
+      if (k & 1)
+        res = mul(res, b);
+    return res;
+  }
+
+  void build_phrase_prefix()
+  {
+    phrase_prefix.resize(ra.d.size());
+    uint64_t h = 0;
+    size_t length = 0, max_length = 0;
+    for (size_t j = 0; j < ra.d.size(); ++j)
+    {
+      if (ra.b_d[j])
+      {
+        h = 0;
+        length = 0;
+      }
+      phrase_prefix[j] = h;
+      h = extend(h, ra.d[j]);
+      max_length = std::max(max_length, ++length);
+    }
+
+    power.resize(max_length + 1);
+    power[0] = 1;
+    for (size_t k = 1; k < power.size(); ++k)
+      power[k] = mul(power[k - 1], base);
+  }
+
+  void build_text_prefix()
+  {
+    // p ends with a 0, the last phrase ends at the end of the text
+    text_prefix.resize(ra.p.size());
+    text_prefix[0] = 0;
+    for (size_t k = 0; k + 1 < ra.p.size(); ++k)
+    {
+      // The last w characters of a phrase are the first w of the next one
+      size_t length = ra.length_of_phrase(ra.p[k]) - ra.w;
+      size_t begin = ra.select_b_d(ra.p[k]);
+      text_prefix[k + 1] = add(mul(text_prefix[k], power[length]), phrase_prefix[begin + length]);
+    }
+  }
+
+  // Fingerprint of the prefix of length q of the text, in the positions of ra after
+  // the cyclic shift by w
+  uint64_t text_fingerprint(size_t q) const
+  {
+    if (q == ra.n)
+      return text_prefix.back();
+    size_t k = ra.rank_b_p(q + 1) - 1;
+    size_t offset = q - ra.select_b_p(k + 1);
+    return add(mul(text_prefix[k], power[offset]), phrase_prefix[ra.select_b_d(ra.p[k]) + offset]);
+  }
+
+  // Fingerprint of the characters in [a, b) of the text after the cyclic shift by w
+  uint64_t text_fingerprint(size_t a, size_t b) const
+  {
+    return sub(text_fingerprint(b), mul(text_fingerprint(a), pow(b - a)));
+  }
+
+  // Whether the text starting in pos and pattern[i, m) have the same prefix of length l
+  bool equal(uint64_t pos, const query &pattern, size_t i, size_t l) const
+  {
+    uint64_t p = sub(pattern.prefix[i + l], mul(pattern.prefix[i], pow(l)));
+
+    size_t a = (pos + ra.w) % ra.n;
+    uint64_t t;
+    if (a + l <= ra.n)
+      t = text_fingerprint(a, a + l);
+    else
+      t = add(mul(text_fingerprint(a, ra.n), pow(a + l - ra.n)), text_fingerprint(0, a + l - ra.n));
+    return p == t;
+  }
+};
+
+#endif /* end of include guard: _PFP_LCE_HH */
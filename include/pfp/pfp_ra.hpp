@@ -27,12 +27,17 @@
 
 #include <common.hpp>
 
+#include <algorithm>
+
 #include <sdsl/rmq_support.hpp>
 #include <sdsl/int_vector.hpp>
+#include <sdsl/sd_vector.hpp>
 #include <sdsl/io.hpp>
 
 
-class pfp_ra{
+// b_p_t is the bitvector marking the starting position of each phrase in the text
+template <class b_p_t = sdsl::sd_vector<>>
+class pfp_ra_t{
 public:
   // Dictionary
   std::vector<uint8_t> d;
@@ -47,16 +52,16 @@ public:
   size_t n; // Size of the text
   size_t w; // Size of the window
 
-  sdsl::bit_vector b_p;
-  sdsl::bit_vector::rank_1_type rank_b_p;
-  sdsl::bit_vector::select_1_type select_b_p;
+  b_p_t b_p;
+  typename b_p_t::rank_1_type rank_b_p;
+  typename b_p_t::select_1_type select_b_p;
 
   typedef size_t size_type;
 
   // Default constructor for load
-  pfp_ra() {}
+  pfp_ra_t() {}
 
-  pfp_ra(std::vector<uint8_t> &d_,
+  pfp_ra_t(std::vector<uint8_t> &d_,
              std::vector<uint32_t> &p_,
              size_t w_) : 
             d(d_),
@@ -78,7 +83,7 @@ public:
     clear_unnecessary_elements();
   }
 
-  pfp_ra( std::string filename, size_t w_):
+  pfp_ra_t( std::string filename, size_t w_):
               w(w_)
   {
     read_dictionary(filename);
@@ -99,7 +104,7 @@ public:
     clear_unnecessary_elements();
   }
 
-  inline size_t length_of_phrase(size_t id)
+  inline size_t length_of_phrase(size_t id) const
   {
     assert(id > 0);
     return select_b_d(id + 1) - select_b_d(id) - 1; // to remove the EndOfWord
@@ -154,6 +159,108 @@ public:
     return d[pos_in_d];
   }
 
+  // Reads the text forward from a position. The phrase containing the position is found
+  // once, then the characters are copied from d up to the end of each phrase.
+  class cursor
+  {
+  public:
+    cursor(const pfp_ra_t &ra_, uint64_t pos) : ra(ra_)
+    {
+      seek(pos);
+    }
+
+    void seek(uint64_t pos)
+    {
+      // This is because, the text is considered to be cyclic.
+      pos = (pos + ra.w) % ra.n;
+
+      phrase_idx = ra.rank_b_p(pos + 1) - 1;
+      set_phrase(pos - ra.select_b_p(phrase_idx + 1));
+    }
+
+    // Copies the next len characters of the text to out
+    void read(uint8_t *out, size_t len)
+    {
+      while (len > 0)
+      {
+        size_t k = std::min(len, size_t(end - ptr));
+        memcpy(out, ptr, k);
+        out += k;
+        len -= k;
+        advance(k);
+      }
+    }
+
+    // Reads the text while it matches pattern[0, len), and returns the length of the match
+    size_t match(const uint8_t *pattern, size_t len)
+    {
+      size_t l = 0;
+      while (l < len)
+      {
+        size_t k = std::min(len - l, size_t(end - ptr));
+        size_t m = common_prefix(ptr, pattern + l, k);
+        l += m;
+        advance(m);
+        if (m < k)
+          break;
+      }
+      return l;
+    }
+
+  private:
+    const pfp_ra_t &ra;
+    size_t phrase_idx;  // Index in p of the current phrase
+    const uint8_t *ptr; // Next character of the text in d
+    const uint8_t *end; // End of the characters of the current phrase in d
+
+    void set_phrase(size_t offset)
+    {
+      uint32_t phrase_id = ra.p[phrase_idx];
+      const uint8_t *begin = ra.d.data() + ra.select_b_d(phrase_id);
+      // The last w characters of a phrase are the first w of the next one
+      end = begin + ra.length_of_phrase(phrase_id) - ra.w;
+      ptr = begin + offset;
+      assert(ptr < end);
+    }
+
+    void advance(size_t k)
+    {
+      ptr += k;
+      if (ptr == end)
+      {
+        // The last phrase is followed by the first one, p ends with a 0
+        phrase_idx = (phrase_idx + 2 < ra.p.size() ? phrase_idx + 1 : 0);
+        set_phrase(0);
+      }
+    }
+  };
+
+  // Copies the characters of the text in [pos, pos + len) to out
+  void extract(uint64_t pos, size_t len, uint8_t *out) const
+  {
+    if (len > 0)
+      cursor(*this, pos).read(out, len);
+  }
+
+  std::string extract(uint64_t pos, size_t len) const
+  {
+    std::string res(len, 0);
+    extract(pos, len, (uint8_t *)&res[0]);
+    return res;
+  }
+
+  // Length of the longest common prefix of pattern[0, len) and the text starting
+  // in pos, that stops at the end of the text
+  size_t match_length(uint64_t pos, const uint8_t *pattern, size_t len) const
+  {
+    if (pos >= n)
+      return 0;
+    len = std::min(len, size_t(n - pos));
+    if (len == 0)
+      return 0;
+    return cursor(*this, pos).match(pattern, len);
+  }
+
   // Serialize to a stream.
   size_type serialize(std::ostream &out, sdsl::structure_tree_node *v = nullptr, std::string name = "") const
   {
@@ -181,11 +288,11 @@ public:
     my_load(p, in);
     my_load(d, in);
     b_d.load(in);
-    rank_b_d.load(in);
-    select_b_d.load(in);
+    rank_b_d.load(in, &b_d);
+    select_b_d.load(in, &b_d);
     b_p.load(in);
-    rank_b_p.load(in);
-    select_b_p.load(in);
+    rank_b_p.load(in, &b_p);
+    select_b_p.load(in, &b_p);
     sdsl::read_member(n, in);
     sdsl::read_member(w, in);
   }
@@ -238,11 +345,10 @@ public:
 
     void build_b_p()
     {
-      // Build the bitvector storing the position of the beginning of each phrase.
-      b_p.resize(this->n); // all should be initialized at false by sdsl
-      for (size_t i = 0; i < b_p.size(); ++i)
-        b_p[i] = false; // bug in resize
-      b_p[0] = true;    // phrase_0 becomes phrase 1
+      // The position of the beginning of each phrase.
+      std::vector<uint64_t> starts;
+      starts.reserve(p.size() - 1);
+      starts.push_back(0); // phrase_0 becomes phrase 1
 
       size_t i = 0;
 
@@ -252,12 +358,30 @@ public:
         assert(p[j] != 0);
         // phrase_length: select_b_d(p[i]+1)-select_b_d(p[i]);
         i += length_of_phrase(p[j]) - w;
-        b_p[i] = true;
+        starts.push_back(i);
       }
 
+      build_bitvector(b_p, this->n, starts);
+
       // Build rank and select on Sp
-      rank_b_p = sdsl::bit_vector::rank_1_type(&b_p);
-      select_b_p = sdsl::bit_vector::select_1_type(&b_p);
+      rank_b_p = typename b_p_t::rank_1_type(&b_p);
+      select_b_p = typename b_p_t::select_1_type(&b_p);
+    }
+
+    // Builds a bitvector of the given size, with ones in the increasing positions of ones
+    static void build_bitvector(sdsl::bit_vector &bv, size_t size, const std::vector<uint64_t> &ones)
+    {
+      bv = sdsl::bit_vector(size, 0);
+      for (auto i : ones)
+        bv[i] = true;
+    }
+
+    static void build_bitvector(sdsl::sd_vector<> &bv, size_t size, const std::vector<uint64_t> &ones)
+    {
+      sdsl::sd_vector_builder builder(size, ones.size());
+      for (auto i : ones)
+        builder.set(i);
+      bv = sdsl::sd_vector<>(builder);
     }
 
     void compute_n()
@@ -273,4 +397,11 @@ public:
     }
 };
 
+// The phrase boundaries in Elias-Fano, that take O(|P| log(n/|P|)) bits
+typedef pfp_ra_t<sdsl::sd_vector<>> pfp_ra_sd;
+// The phrase boundaries in a plain bitvector of n bits
+typedef pfp_ra_t<sdsl::bit_vector> pfp_ra_bv;
+
+typedef pfp_ra_sd pfp_ra;
+
 #endif /* end of include guard: _PFP_RA_HH */
@@ -34,6 +34,117 @@ extern "C"
 }
 
 #include <pfp.hpp>
+#include <ilist_merge.hpp>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <limits>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <functional>
+
+// Thresholds of the characters waiting for their next run in BWT_T. Closing a run
+// lowers the threshold of all the characters but the head of the run, hence we keep
+// a segment tree over the alphabet with lazy min tags, costing O(log sigma) per run.
+class thresholds_tree{
+public:
+    typedef std::pair<uint64_t, uint64_t> value_t; // Minimum lcp_T and its position
+
+    thresholds_tree() {}
+
+    thresholds_tree(const std::vector<uint8_t> &alphabet, value_t init_value) :
+                rank(256, 0)
+    {
+        for (size_t i = 0; i < alphabet.size(); ++i)
+            rank[alphabet[i]] = i;
+
+        k = 1;
+        while (k < alphabet.size())
+            k <<= 1;
+        tag.assign(2 * k, init_value);
+    }
+
+    // Lowers the value of every character other than c to v, if v is smaller
+    inline void update_except(uint8_t c, const value_t &v)
+    {
+        update(0, rank[c], v);
+        update(rank[c] + 1, k, v);
+    }
+
+    inline value_t get(uint8_t c) const
+    {
+        size_t node = k + rank[c];
+        value_t v = tag[node];
+        for (node >>= 1; node > 0; node >>= 1)
+            v = std::min(v, tag[node]);
+        return v;
+    }
+
+    inline void set(uint8_t c, const value_t &v)
+    {
+        // Push the tags on the path to c down to the children
+        const size_t leaf = k + rank[c];
+        for (size_t h = bits(k); h > 0; --h)
+        {
+            const size_t node = leaf >> h;
+            chmin(2 * node, tag[node]);
+            chmin(2 * node + 1, tag[node]);
+            tag[node] = {std::numeric_limits<uint64_t>::max(), 0};
+        }
+        tag[leaf] = v;
+    }
+
+    void serialize(std::ostream &out) const
+    {
+        sdsl::write_member(k, out);
+        out.write((const char *)tag.data(), tag.size() * sizeof(value_t));
+    }
+
+    // The tree has to be built on the same alphabet
+    bool load(std::istream &in)
+    {
+        size_t k_ = 0;
+        sdsl::read_member(k_, in);
+        if (k_ != k)
+            return false;
+        in.read((char *)tag.data(), tag.size() * sizeof(value_t));
+        return (bool)in;
+    }
+
+private:
+    std::vector<size_t> rank; // Rank of each character in the alphabet
+    size_t k = 1;             // Number of leaves, a power of two
+    std::vector<value_t> tag;
+
+    inline void chmin(size_t node, const value_t &v)
+    {
+        if (v < tag[node])
+            tag[node] = v;
+    }
+
+    // Lower the values of the ranks in [l, r)
+    inline void update(size_t l, size_t r, const value_t &v)
+    {
+        for (l += k, r += k; l < r; l >>= 1, r >>= 1)
+        {
+            if (l & 1)
+                chmin(l++, v);
+            if (r & 1)
+                chmin(--r, v);
+        }
+    }
+
+    static inline size_t bits(size_t x)
+    {
+        size_t h = 0;
+        while ((size_t(1) << h) < x)
+            ++h;
+        return h;
+    }
+};
 
 class pfp_thresholds{
 public:
@@ -47,59 +158,451 @@ public:
 
     bool rle;
 
-    pfp_thresholds(pf_parsing &pfp_, std::string filename, bool rle_ = false) : 
+    // Outputs of the scan of saD, any combination can be computed in one pass
+    static const unsigned THRESHOLDS = 1; // infile.thr and infile.thr_pos
+    static const unsigned LCP = 2;        // infile.lcp
+    static const unsigned SA = 4;         // infile.ssa and infile.esa
+    static const unsigned BWT = 8;        // infile.bwt, or infile.bwt.heads and infile.bwt.len with rle
+    static const unsigned RUNS = 16;      // the runs of BWT_T, given to run_consumer
+
+    unsigned outputs;
+
+    // A run of BWT_T, with the SA samples and the threshold written in the files
+    typedef struct
+    {
+        uint8_t head;
+        size_t length;
+        size_t ssa;       // SA sample at the beginning of the run
+        size_t esa;       // SA sample at the end of the run
+        size_t threshold; // Position of the threshold of the run
+    } bwt_run_t;
+
+    typedef std::function<void(const bwt_run_t &)> run_consumer_t;
+
+    // With checkpoint_interval > 0, the state of the scan is saved in filename.ckpt
+    // every checkpoint_interval seconds, and a later run with the same outputs
+    // resumes from the last checkpoint. With RUNS, the runs of BWT_T are given in
+    // order to run_consumer_, and there are no checkpoints.
+    pfp_thresholds(pf_parsing &pfp_, std::string filename, bool rle_ = false, size_t n_threads = 1,
+                   unsigned outputs_ = THRESHOLDS | SA | BWT, size_t checkpoint_interval_ = 0,
+                   run_consumer_t run_consumer_ = nullptr) : 
                 pf(pfp_),
                 min_s(pf.n),
                 pos_s(0),
                 head(0),
                 sa_mod(pf.n - pf.w + 1ULL),
-                thresholds(256, pf.n),
-                thresholds_pos(256, 0),
+                thresholds(pf.dict.alphabet, {pf.n, 0}),
                 never_seen(256, true),
-                rle(rle_)
+                rle(rle_),
+                outputs(outputs_),
+                checkpoint_interval((outputs_ & RUNS) ? 0 : checkpoint_interval_),
+                checkpoint_filename(filename + std::string(".ckpt")),
+                run_consumer(run_consumer_)
     {
+        assert(!(outputs & RUNS) || run_consumer);
+
+        // The outputs written before the checkpoint are kept
+        size_t begin = 1; // The first entry of saD is the EndOfDict
+        std::vector<size_t> sizes;
+        const bool resume = (checkpoint_interval > 0 && load_checkpoint(begin, sizes));
+        if (resume)
+            verbose("Resuming from ", checkpoint_filename, " at position ", begin, " of saD");
+
         // Opening output files
-        std::string outfile = filename + std::string(".thr");
-        if ((thr_file = fopen(outfile.c_str(), "w")) == nullptr)
-            error("open() file " + outfile + " failed");
+        if (outputs & THRESHOLDS)
+        {
+            thr_file.open(filename + std::string(".thr"), buffered_writer::default_buffer_size, !resume);
+            thr_pos_file.open(filename + std::string(".thr_pos"), buffered_writer::default_buffer_size, !resume);
+        }
+        if (outputs & LCP)
+        {
+            lcp_filename = filename + std::string(".lcp");
+            lcp_file.open(lcp_filename, buffered_writer::default_buffer_size, !resume);
+        }
+        if (outputs & SA)
+        {
+            ssa_file.open(filename + std::string(".ssa"), buffered_writer::default_buffer_size, !resume);
+            esa_file.open(filename + std::string(".esa"), buffered_writer::default_buffer_size, !resume);
+        }
+        if (outputs & BWT)
+        {
+            if(rle)
+            {
+                bwt_file.open(filename + std::string(".bwt.heads"), buffered_writer::default_buffer_size, !resume);
+                bwt_file_len.open(filename + std::string(".bwt.len"), buffered_writer::default_buffer_size, !resume);
+            }else{
+                bwt_file.open(filename + std::string(".bwt"), buffered_writer::default_buffer_size, !resume);
+            }
+        }
+
+        // The LCP is written in place, all the other outputs are cut at the checkpoint
+        if (resume)
+        {
+            std::vector<buffered_writer *> files = sequential_files();
+            for (size_t k = 0; k < files.size(); ++k)
+                if (files[k]->is_open())
+                    files[k]->truncate(sizes[k]);
+        }
 
-        outfile = filename + std::string(".thr_pos");
-        if ((thr_pos_file = fopen(outfile.c_str(), "w")) == nullptr)
-            error("open() file " + outfile + " failed");
+        assert(pf.dict.d[pf.dict.saD[0]] == EndOfDict);
 
-        outfile = filename + std::string(".ssa");
-        if ((ssa_file = fopen(outfile.c_str(), "w")) == nullptr)
-            error("open() file " + outfile + " failed");
+        n_threads = std::max(n_threads, size_t(1));
+        std::vector<chunk_t> chunks = split_saD(n_threads, begin);
+        last_checkpoint = std::chrono::steady_clock::now();
 
-        outfile = filename + std::string(".esa");
-        if ((esa_file = fopen(outfile.c_str(), "w")) == nullptr)
-            error("open() file " + outfile + " failed");
+        // The chunks write their LCP values directly in place, hence we need their offsets in BWT_T
+        if (outputs & LCP)
+            compute_chunk_offsets(chunks, n_threads);
 
+        if (n_threads == 1)
+        {
+            for (size_t k = 0; k < chunks.size(); ++k)
+            {
+                scan_chunk(chunks[k]);
+                merge_chunk(chunks[k]);
+                checkpoint(chunks, k);
+            }
+        }
+        else
+        {
+            // The chunks are scanned by the workers and merged in order by this thread.
+            // Workers do not start chunks too far ahead of the merge, to bound the memory.
+            const size_t window = chunks_per_thread * n_threads;
+
+            std::mutex m;
+            std::condition_variable cv;
+            std::vector<bool> scanned(chunks.size(), false);
+            size_t merged = 0;
+            std::atomic<size_t> next_chunk(0);
+
+            auto worker = [&]() {
+                size_t k;
+                while ((k = next_chunk++) < chunks.size())
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(m);
+                        cv.wait(lock, [&] { return k < merged + window; });
+                    }
+
+                    scan_chunk(chunks[k]);
+
+                    {
+                        std::lock_guard<std::mutex> lock(m);
+                        scanned[k] = true;
+                    }
+                    cv.notify_all();
+                }
+            };
+
+            std::vector<std::thread> workers;
+            for (size_t i = 0; i < n_threads; ++i)
+                workers.emplace_back(worker);
+
+            for (size_t k = 0; k < chunks.size(); ++k)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    cv.wait(lock, [&] { return scanned[k]; });
+                }
+
+                merge_chunk(chunks[k]);
+                checkpoint(chunks, k);
+
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    merged++;
+                }
+                cv.notify_all();
+            }
+
+            for (auto &t : workers)
+                t.join();
+        }
+
+        // print lat BWT char and SA sample
+        print_sa();
+        print_bwt();
+        print_run();
+
+        // Close output files
+        thr_file.close();
+        thr_pos_file.close();
+        lcp_file.close();
+        ssa_file.close();
+        esa_file.close();
+        bwt_file.close();
         if(rle)
+            bwt_file_len.close();
+
+        if (checkpoint_interval > 0)
+            std::remove(checkpoint_filename.c_str());
+    }
+
+private:
+    typedef struct
+    {
+        size_t i = 0; // This should be safe since the first entry of sa is always the dollarsign used to compute the sa
+        size_t phrase = 0;
+        size_t suffix_length = 0;
+        int_da sn = 0;
+        uint8_t bwt_char = 0;
+        bool valid = false;
+    } phrase_suffix_t;
+
+    // A run of BWT_T computed by scanning a chunk
+    typedef struct
+    {
+        uint8_t head;
+        size_t length;
+        size_t min_s; // Minimum lcp_T in the run, including the one at the beginning of the next run in the chunk
+        size_t pos_s; // Position of min_s, relative to the beginning of the chunk
+        size_t ssa;   // SA sample at the beginning of the run
+        size_t esa;   // SA sample at the end of the run
+    } run_t;
+
+    // A range [begin, end) of saD that can be scanned independently from the others.
+    // The first lcp_T of the chunk depends on the previous chunks, so it is computed when merging.
+    typedef struct
+    {
+        size_t begin;
+        size_t end;
+
+        size_t offset = 0; // Position in BWT_T of the first suffix of the chunk, used only for the LCP
+
+        size_t j = 0; // Length of BWT_T computed so far in the chunk
+        size_t ssa = 0;
+        size_t first_occ = 0; // First occurrence of same suffix phrases in BWT_P
+        size_t last_occ = 0;  // Last occurrence of same suffix phrases in BWT_P
+
+        int_t first_lcp = 0; // Minimum lcpD from begin to the first suffix scanned
+        int_t last_lcp = 0;  // Minimum lcpD from the last suffix scanned to end
+        std::vector<run_t> runs;
+    } chunk_t;
+
+    static const size_t chunks_per_thread = 16;
+    static const size_t max_chunk_size = 1ULL << 20; // Maximum number of entries of saD in a chunk
+
+    size_t j = 0;
+
+    const size_t sa_mod = (pf.n - pf.w + 1ULL);
+
+    size_t ssa = 0;
+    size_t esa = 0;
+
+    int_t last_lcp = 0; // Minimum lcpD after the last suffix scanned in the chunks merged so far
+
+    thresholds_tree thresholds;
+    std::vector<bool> never_seen;
+
+    buffered_writer bwt_file;
+    buffered_writer bwt_file_len;
+
+    buffered_writer ssa_file;
+    buffered_writer esa_file;
+
+    buffered_writer thr_file;
+    buffered_writer thr_pos_file;
+
+    std::string lcp_filename;
+    buffered_writer lcp_file;
+
+    run_consumer_t run_consumer;
+    size_t run_ssa = 0;       // SA sample at the beginning of the current run of BWT_T
+    size_t run_threshold = 0; // Threshold of the current run of BWT_T
+
+    size_t checkpoint_interval; // Seconds between two checkpoints, 0 for no checkpoints
+    std::string checkpoint_filename;
+    std::chrono::steady_clock::time_point last_checkpoint;
+
+    static const uint64_t CKPT_MAGIC = 0x3130544e504b4354ULL; // "TCKPNT01"
+
+    // The outputs written sequentially, in the order of the checkpoint
+    std::vector<buffered_writer *> sequential_files()
+    {
+        return {&thr_file, &thr_pos_file, &ssa_file, &esa_file, &bwt_file, &bwt_file_len};
+    }
+
+    // Saves the state of the merge after chunk k, if the last checkpoint is old enough
+    void checkpoint(std::vector<chunk_t> &chunks, size_t k)
+    {
+        if (checkpoint_interval == 0 || k + 1 == chunks.size())
+            return;
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_checkpoint < std::chrono::seconds(checkpoint_interval))
+            return;
+
+        verbose("Checkpoint at position ", chunks[k + 1].begin, " of saD");
+        _elapsed_time(write_checkpoint(chunks[k + 1].begin));
+        last_checkpoint = std::chrono::steady_clock::now();
+    }
+
+    // The outputs reach the disk before the checkpoint, that replaces the previous one only when complete
+    void write_checkpoint(size_t begin)
+    {
+        std::vector<uint64_t> sizes;
+        for (auto file : sequential_files())
         {
-            outfile = filename + std::string(".bwt.heads");
-            if ((bwt_file = fopen(outfile.c_str(), "w")) == nullptr)
-                error("open() file " + outfile + " failed");
+            sizes.push_back(0);
+            if (file->is_open())
+            {
+                sizes.back() = file->tell();
+                file->sync();
+            }
+        }
+        if (lcp_file.is_open())
+            lcp_file.sync();
+
+        std::stringstream out;
+        const uint64_t magic = CKPT_MAGIC;
+        sdsl::write_member(magic, out);
+        write_checkpoint_key(out);
+        sdsl::write_member(begin, out);
+        sdsl::write_member(j, out);
+        sdsl::write_member(min_s, out);
+        sdsl::write_member(pos_s, out);
+        sdsl::write_member(head, out);
+        sdsl::write_member(length, out);
+        sdsl::write_member(ssa, out);
+        sdsl::write_member(esa, out);
+        sdsl::write_member(last_lcp, out);
+        for (size_t c = 0; c < never_seen.size(); ++c)
+            sdsl::write_member((uint8_t)never_seen[c], out);
+        thresholds.serialize(out);
+        for (auto size : sizes)
+            sdsl::write_member(size, out);
+
+        std::string tmp_filename = checkpoint_filename + std::string(".tmp");
+        {
+            const std::string data = out.str();
+            buffered_writer tmp_file(tmp_filename);
+            tmp_file.write(data.data(), data.size());
+            tmp_file.sync();
+        }
+        if (rename(tmp_filename.c_str(), checkpoint_filename.c_str()) < 0)
+            error("rename() file " + tmp_filename + " failed");
+    }
 
-            outfile = filename + std::string(".bwt.len");
-            if ((bwt_file_len = fopen(outfile.c_str(), "w")) == nullptr)
-                error("open() file " + outfile + " failed");
+    // Identifies the scan, a checkpoint is used only by a scan with the same key
+    void write_checkpoint_key(std::ostream &out)
+    {
+        sdsl::write_member((uint64_t)pf.n, out);
+        sdsl::write_member((uint64_t)pf.w, out);
+        sdsl::write_member((uint64_t)pf.dict.saD.size(), out);
+        sdsl::write_member((uint64_t)pf.pars.ilist_view.size(), out);
+        sdsl::write_member((uint64_t)outputs, out);
+        sdsl::write_member((uint64_t)rle, out);
+    }
 
-        }else{
+    // Restores the state of the merge, returns false if there is no valid checkpoint
+    bool load_checkpoint(size_t &begin, std::vector<size_t> &sizes)
+    {
+        std::ifstream in(checkpoint_filename, std::ios::binary);
+        if (!in)
+            return false;
 
-            outfile = filename + std::string(".bwt");
-            if ((bwt_file = fopen(outfile.c_str(), "w")) == nullptr)
-                error("open() file " + outfile + " failed");
+        uint64_t magic = 0;
+        sdsl::read_member(magic, in);
+        std::string key(6 * sizeof(uint64_t), 0);
+        in.read(&key[0], key.size());
+        std::stringstream expected_key;
+        write_checkpoint_key(expected_key);
+        if (!in || magic != CKPT_MAGIC || key != expected_key.str())
+        {
+            verbose("Ignoring ", checkpoint_filename, ", it does not match this scan");
+            return false;
+        }
 
+        sdsl::read_member(begin, in);
+        sdsl::read_member(j, in);
+        sdsl::read_member(min_s, in);
+        sdsl::read_member(pos_s, in);
+        sdsl::read_member(head, in);
+        sdsl::read_member(length, in);
+        sdsl::read_member(ssa, in);
+        sdsl::read_member(esa, in);
+        sdsl::read_member(last_lcp, in);
+        for (size_t c = 0; c < never_seen.size(); ++c)
+        {
+            uint8_t seen = 0;
+            sdsl::read_member(seen, in);
+            never_seen[c] = seen;
         }
+        bool valid = thresholds.load(in);
+        sizes.assign(sequential_files().size(), 0);
+        for (auto &size : sizes)
+            sdsl::read_member(size, in);
 
-        assert(pf.dict.d[pf.dict.saD[0]] == EndOfDict);
+        if (!valid || !in)
+            error("invilid file " + checkpoint_filename);
+        return true;
+    }
+
+    // Splits saD in chunks. A chunk can begin only at a position i with lcpD[i] < w,
+    // where no group of suffixes of length at least w can continue.
+    // The chunks cover saD from first, that has to be such a position.
+    std::vector<chunk_t> split_saD(size_t n_threads, size_t first)
+    {
+        const size_t size = pf.dict.saD.size();
+        size_t n_chunks = (n_threads == 1 ? 1 : chunks_per_thread * n_threads);
+        n_chunks = std::max(n_chunks, (size - first + max_chunk_size - 1) / max_chunk_size);
+
+        std::vector<chunk_t> chunks;
+        size_t begin = first;
+        for (size_t k = 1; k <= n_chunks && begin < size; ++k)
+        {
+            size_t end = std::max(begin + 1, first + (size - first) * k / n_chunks);
+            while (end < size && pf.dict.lcpD[end] >= (int_t)pf.w)
+                ++end;
+
+            chunk_t chunk;
+            chunk.begin = begin;
+            chunk.end = std::min(end, size);
+            chunks.push_back(chunk);
+
+            begin = chunk.end;
+        }
+
+        return chunks;
+    }
 
+    // Each valid suffix of D contributes one entry of BWT_T for each occurrence of its phrase
+    void compute_chunk_offsets(std::vector<chunk_t> &chunks, size_t n_threads)
+    {
+        std::vector<size_t> length(chunks.size(), 0);
+        parallel_for(0, chunks.size(), n_threads, [&](size_t b, size_t e, size_t t) {
+            for (size_t k = b; k < e; ++k)
+                for (size_t i = chunks[k].begin; i < chunks[k].end; ++i)
+                    if (pf.dict.valid_saD[i])
+                        length[k] += pf.get_freq(pf.dict.phrase_saD[i]);
+        });
+
+        size_t offset = j; // The chunks follow the part of BWT_T already merged
+        for (size_t k = 0; k < chunks.size(); ++k)
+        {
+            chunks[k].offset = offset;
+            offset += length[k];
+        }
+    }
+
+    // Computes the runs of BWT_T of the suffixes in the chunk
+    void scan_chunk(chunk_t &ch)
+    {
         phrase_suffix_t curr;
         phrase_suffix_t prev;
 
+        ilist_merge<packed_view> merge(pf.pars.ilist_view);
+
+        // The first LCP value of the chunk is written when merging
+        buffered_writer lcp_out;
+        if (outputs & LCP)
+        {
+            lcp_out.open(lcp_filename, buffered_writer::default_buffer_size, false);
+            lcp_out.seek((ch.offset + 1) * THRBYTES);
+        }
+
+        curr.i = ch.begin - 1;
         inc(curr);
-        while (curr.i < pf.dict.saD.size())
+        while (curr.i < ch.end)
         {
 
             if(is_valid(curr)){
@@ -108,8 +611,8 @@ public:
 
                 bool same_chars = true;
 
-                init_first_last_occ();
-                update_first_last_occ(curr);
+                init_first_last_occ(ch);
+                update_first_last_occ(ch, curr);
 
                 phrase_suffix_t next = curr;
 
@@ -124,90 +627,91 @@ public:
 
                         same_suffix.push_back(next);
 
-                        update_first_last_occ(next);
+                        update_first_last_occ(ch, next);
                     }
 
                 }
 
-                // Simple case
-                if (same_chars)
+                // Simple case, the LCP output needs the values inside the runs
+                if (same_chars && !(outputs & LCP))
                 {
 
-                    update_ssa(same_suffix[0], first_occ);
+                    update_ssa(ch, same_suffix[0], ch.first_occ);
 
                     for (auto curr : same_suffix)
                     {
                         // curr = elem;
                         // Compute phrase boundary lcp
-                        int_t lcp_suffix = compute_lcp_suffix(curr,prev);
+                        int_t lcp_suffix = compute_lcp_suffix(ch, curr, prev);
 
                         // Update min_s
-                        update_min_s(lcp_suffix,j);
+                        update_min_s(ch, lcp_suffix);
 
 
-                        update_bwt(curr.bwt_char, pf.get_freq(curr.phrase));
-                        update_min_s(lcp_suffix,j);
+                        update_bwt(ch, curr.bwt_char, pf.get_freq(curr.phrase));
+                        update_min_s(ch, lcp_suffix);
 
 
                         // Update prevs
                         prev = curr;
 
-                        j += pf.get_freq(curr.phrase);
+                        ch.j += pf.get_freq(curr.phrase);
                     }
 
-                    update_esa(same_suffix[0], last_occ);
+                    update_esa(ch, same_suffix[0], ch.last_occ);
                 }
                 else
                 {
                     // Hard case
-                    int_t lcp_suffix = compute_lcp_suffix(curr,prev);
-
-                    typedef std::pair<int_t *, std::pair<int_t *, uint8_t>> pq_t;
-
-                    // using lambda to compare elements.
-                    auto cmp = [](const pq_t &lhs, const pq_t &rhs) {
-                        return *lhs.first > *rhs.first;
-                    };
+                    int_t lcp_suffix = compute_lcp_suffix(ch, curr, prev);
+                    if (ch.j > 0)
+                        print_lcp(lcp_out, lcp_suffix);
 
-                    std::priority_queue<pq_t, std::vector<pq_t>, decltype(cmp)> pq(cmp);
+                    merge.clear();
                     for (auto s: same_suffix)
-                    {
-                        size_t begin = pf.pars.select_ilist_s(s.phrase + 1);
-                        size_t end = pf.pars.select_ilist_s(s.phrase + 2);
-                        pq.push({&pf.pars.ilist[begin], {&pf.pars.ilist[end], s.bwt_char}});
-                    }
+                        merge.push(pf.pars.select_ilist_s(s.phrase + 1), pf.pars.select_ilist_s(s.phrase + 2), s.bwt_char);
+                    merge.init();
 
-                    size_t prev_occ;
+                    size_t prev_occ = 0;
                     bool first = true;
-                    while (!pq.empty())
+                    size_t r, b, e;
+                    while (merge.next_block(r, b, e))
                     {
-                        auto curr_occ = pq.top();
-                        pq.pop();
+                        // The occurrences in [b, e) are consecutive in BWT_P and have the same BWT character
+                        const size_t first_occ = pf.pars.ilist_view[b];
+                        const size_t last_occ = pf.pars.ilist_view[e - 1];
+                        const size_t block_length = e - b;
 
                         if (!first)
                         {
                             // Compute the minimum s_lcpP of the the current and previous occurrence of the phrase in BWT_P
-                            lcp_suffix = curr.suffix_length + min_s_lcp_T(*curr_occ.first, prev_occ);
+                            lcp_suffix = curr.suffix_length + min_s_lcp_T(first_occ, prev_occ);
+                            print_lcp(lcp_out, lcp_suffix);
                         }
                         first = false;
+
+                        if (outputs & LCP)
+                            for (size_t k = b + 1; k < e; ++k)
+                                print_lcp(lcp_out, curr.suffix_length + min_s_lcp_T(pf.pars.ilist_view[k], pf.pars.ilist_view[k - 1]));
                         // Update min_s
-                        update_min_s(lcp_suffix, j);
+                        update_min_s(ch, lcp_suffix);
 
-                        update_ssa(curr, *curr_occ.first);
+                        update_ssa(ch, curr, first_occ);
 
-                        update_bwt(curr_occ.second.second, 1);
-                        update_min_s(lcp_suffix, j);
+                        update_bwt(ch, merge.ranges[r].bwt_char, block_length);
+                        update_min_s(ch, lcp_suffix);
 
-                        update_esa(curr, *curr_occ.first);
-                        // Update prevs
-                        prev_occ = *curr_occ.first;
+                        if (block_length > 1)
+                        {
+                            update_min_s_block(ch, curr, b, e);
+                            update_ssa(ch, curr, last_occ);
+                        }
 
-                        // Update pq
-                        curr_occ.first++;
-                        if (curr_occ.first != curr_occ.second.first)
-                            pq.push(curr_occ);
+                        update_esa(ch, curr, last_occ);
+                        // Update prevs
+                        prev_occ = last_occ;
 
-                        j += 1;
+                        ch.j += block_length;
                     }
 
                     prev = same_suffix.back();
@@ -221,79 +725,96 @@ public:
             }
         }
 
-        // print lat BWT char and SA sample
-        print_sa();
-        print_bwt();
-
-        // Close output files
-        fclose(thr_file);
-        fclose(thr_pos_file);
-        fclose(ssa_file);
-        fclose(esa_file);
-        fclose(bwt_file);
-        if(rle)
-            fclose(bwt_file_len);
+        // Minimum lcpD from the last suffix scanned to the end of the chunk
+        size_t k = (ch.j > 0 ? prev.i + 1 : ch.begin);
+        ch.last_lcp = pf.n + 10;
+        for (; k < ch.end; ++k)
+            ch.last_lcp = std::min(ch.last_lcp, pf.dict.lcpD[k]);
     }
 
-private:
-    typedef struct
+    // Appends the runs of the chunk to BWT_T and outputs the runs that are complete
+    void merge_chunk(chunk_t &ch)
     {
-        size_t i = 0; // This should be safe since the first entry of sa is always the dollarsign used to compute the sa
-        size_t phrase = 0;
-        size_t suffix_length = 0;
-        int_da sn = 0;
-        uint8_t bwt_char = 0;
-    } phrase_suffix_t;
+        if (ch.runs.empty())
+        {
+            last_lcp = std::min(last_lcp, ch.last_lcp);
+            return;
+        }
 
-    
-    size_t j = 0;
+        // Phrase boundary lcp of the first suffix of the chunk
+        int_t lcp_suffix = 0;
+        if (j > 0)
+            lcp_suffix = std::min(last_lcp, ch.first_lcp);
 
-    size_t first_occ = pf.n; // First occurrence of same suffix phrases in BWT_P
-    size_t last_occ = 0;     // Last occurrence of same suffix phrases in BWT_P
+        const size_t offset = j;
 
-    const size_t sa_mod = (pf.n - pf.w + 1ULL);
+        if (outputs & LCP)
+        {
+            assert(ch.offset == j);
+            lcp_file.seek(j * THRBYTES);
+            print_lcp(lcp_file, lcp_suffix);
+        }
 
-    size_t ssa = 0;
-    size_t esa = 0;
+        update_min_s(lcp_suffix, j);
+        for (size_t k = 0; k < ch.runs.size(); ++k)
+        {
+            run_t &run = ch.runs[k];
 
-    std::vector<uint64_t> thresholds;
-    std::vector<uint64_t> thresholds_pos;
-    std::vector<bool> never_seen;
+            if (head != run.head)
+            {
+                print_run();
 
-    FILE *bwt_file;
-    FILE *bwt_file_len;
+                ssa = run.ssa;
+                run_ssa = run.ssa;
 
-    FILE *ssa_file;
-    FILE *esa_file;
+                // Print threshold
+                run_threshold = print_threshold(run.head);
+                print_sa();
+                print_bwt();
+
+                head = run.head;
+                length = 0;
+                // Create the new min
+                new_min_s(pf.n + 10, j);
+            }
+            if (k == 0)
+                update_min_s(lcp_suffix, j);
 
-    FILE *thr_file;
-    FILE *thr_pos_file;
+            update_min_s(run.min_s, offset + run.pos_s);
+
+            length += run.length;
+            j += run.length;
+            esa = run.esa;
+        }
+        ssa = ch.ssa;
+
+        last_lcp = ch.last_lcp;
+
+        // Release the memory of the chunk
+        std::vector<run_t>().swap(ch.runs);
+    }
 
     inline bool inc(phrase_suffix_t& s)
     {
         s.i++;
         if (s.i >= pf.dict.saD.size())
             return false;
+        // The phrase metadata is precomputed in saD order by the dictionary
         s.sn = pf.dict.saD[s.i];
-        s.phrase = pf.dict.rank_b_d(s.sn); 
-        // s.phrase = pf.dict.daD[s.i] + 1; // + 1 because daD is 0-based
-        assert(!is_valid(s) || (s.phrase > 0 && s.phrase < pf.pars.ilist.size()));
-        s.suffix_length = pf.dict.select_b_d(pf.dict.rank_b_d(s.sn + 1) + 1) - s.sn - 1;
+        s.phrase = pf.dict.phrase_saD[s.i];
+        s.suffix_length = pf.dict.suffix_length_saD[s.i];
+        s.valid = pf.dict.valid_saD[s.i];
+        assert(!is_valid(s) || (s.phrase > 0 && s.phrase < pf.pars.ilist_view.size()));
         if(is_valid(s))
-            s.bwt_char = (s.sn == pf.w ? 0 : pf.dict.d[s.sn - 1]);
+            s.bwt_char = pf.dict.bwt_char_saD[s.i];
         return true;
     }
 
     inline bool is_valid(phrase_suffix_t& s)
     {
-        // avoid the extra w # at the beginning of the text
-        if (s.sn < pf.w)
-            return false;
-        // Check if the suffix has length at least w and is not the complete phrase.
-        if (pf.dict.b_d[s.sn] != 0 || s.suffix_length < pf.w)
-            return false;
-        
-        return true;
+        // The suffix does not start in the extra w # at the beginning of the text,
+        // it has length at least w, and it is not the complete phrase.
+        return s.valid;
     }
     
     inline int_t min_s_lcp_T(size_t left, size_t right)
@@ -302,16 +823,29 @@ private:
         if (left > right)
             std::swap(left, right);
 
-        assert(pf.s_lcp_T[pf.rmq_s_lcp_T(left + 1, right)] >= pf.w);
+        const size_t min_s_lcp = pf.rmq_s_lcp_T(left + 1, right);
+        assert(min_s_lcp >= pf.w);
 
-        return (pf.s_lcp_T[pf.rmq_s_lcp_T(left + 1, right)] - pf.w);
+        return (min_s_lcp - pf.w);
     }
 
-    inline int_t compute_lcp_suffix(phrase_suffix_t& curr, phrase_suffix_t& prev)
+    inline int_t compute_lcp_suffix(chunk_t &ch, phrase_suffix_t& curr, phrase_suffix_t& prev)
     {
         int_t lcp_suffix = 0;
 
-        if (j > 0)
+        if (ch.j == 0)
+        {
+            // The previous suffix is in a previous chunk, the lcp is completed when merging
+            ch.first_lcp = pf.dict.lcpD[curr.i];
+            for (size_t k = ch.begin; k < curr.i; ++k)
+                ch.first_lcp = std::min(ch.first_lcp, pf.dict.lcpD[k]);
+
+            // Since lcpD[ch.begin] < w, the lcp is smaller than the suffix length
+            assert(ch.begin == 1 || ch.first_lcp < curr.suffix_length);
+
+            lcp_suffix = pf.n + 10;
+        }
+        else
         {
             // Compute phrase boundary lcp
             lcp_suffix = pf.dict.lcpD[curr.i];
@@ -324,9 +858,9 @@ private:
             {
                 // Compute the minimum s_lcpP of the phrases following the two phrases
                 // we take the first occurrence of the phrase in BWT_P
-                size_t left = pf.pars.ilist[pf.pars.select_ilist_s(curr.phrase + 1)]; //size_t left = first_P_BWT_P[phrase];
+                size_t left = pf.pars.ilist_view[pf.pars.select_ilist_s(curr.phrase + 1)]; //size_t left = first_P_BWT_P[phrase];
                 // and the last occurrence of the previous phrase in BWT_P
-                size_t right = pf.pars.ilist[pf.pars.select_ilist_s(prev.phrase + 2) - 1]; //last_P_BWT_P[prev_phrase];
+                size_t right = pf.pars.ilist_view[pf.pars.select_ilist_s(prev.phrase + 2) - 1]; //last_P_BWT_P[prev_phrase];
                 
                 lcp_suffix += min_s_lcp_T(left,right);
             }
@@ -335,12 +869,46 @@ private:
         return lcp_suffix;
     }
 
+    inline void update_min_s(chunk_t &ch, int_t val)
+    {
+        if (!ch.runs.empty() && val < ch.runs.back().min_s)
+        {
+            ch.runs.back().min_s = val;
+            ch.runs.back().pos_s = ch.j;
+        }
+    }
+
+    // Updates min_s with the phrase boundary lcps between the occurrences in [b, e) of ilist,
+    // using one RMQ for the whole block, and a binary search only if the minimum changes.
+    inline void update_min_s_block(chunk_t &ch, phrase_suffix_t &curr, size_t b, size_t e)
+    {
+        const size_t first_occ = pf.pars.ilist_view[b];
+        const int_t block_min = curr.suffix_length + min_s_lcp_T(first_occ, pf.pars.ilist_view[e - 1]);
+        if (block_min >= ch.runs.back().min_s)
+            return;
+
+        // The lcp of the prefix of the block is non-increasing, find the first occurrence reaching block_min
+        size_t l = b + 1;
+        size_t r = e - 1;
+        while (l < r)
+        {
+            size_t m = l + ((r - l) >> 1);
+            if (curr.suffix_length + min_s_lcp_T(first_occ, pf.pars.ilist_view[m]) > block_min)
+                l = m + 1;
+            else
+                r = m;
+        }
+
+        ch.runs.back().min_s = block_min;
+        ch.runs.back().pos_s = ch.j + (l - b);
+    }
+
     inline void update_min_s(int_t val, size_t pos)
     {
         if (val < min_s)
         {
             min_s = val;
-            pos_s = j;
+            pos_s = pos;
         }
     }
 
@@ -348,133 +916,117 @@ private:
     inline void new_min_s(int_t val, size_t pos)
     {
         min_s = val;
-        pos_s = j;
+        pos_s = pos;
     }
 
-    inline void update_ssa(phrase_suffix_t &curr, size_t pos)
+    inline void update_ssa(chunk_t &ch, phrase_suffix_t &curr, size_t pos)
     {   // We do not need to add w because pf.pos_T has w character more at the beginning
-        ssa = (sa_mod + pf.pos_T[pos] - curr.suffix_length) % (sa_mod); // + pf.w;
+        ch.ssa = (sa_mod + pf.pos_T_view[pos] - curr.suffix_length) % (sa_mod); // + pf.w;
         // ssa = (pf.pos_T[pos] - curr.suffix_length) % (pf.n - pf.w + 1ULL); // + pf.w;
-        assert(ssa < (pf.n - pf.w + 1ULL));
+        assert(ch.ssa < (pf.n - pf.w + 1ULL));
     }
 
-    inline void update_esa(phrase_suffix_t &curr, size_t pos)
+    inline void update_esa(chunk_t &ch, phrase_suffix_t &curr, size_t pos)
     {
-        esa = (sa_mod + pf.pos_T[pos] - curr.suffix_length)% (sa_mod);// + pf.w;
+        ch.runs.back().esa = (sa_mod + pf.pos_T_view[pos] - curr.suffix_length)% (sa_mod);// + pf.w;
         // esa = (pf.pos_T[pos] - curr.suffix_length)% (pf.n - pf.w + 1ULL);// + pf.w;
-        assert(esa < (pf.n - pf.w + 1ULL));
+        assert(ch.runs.back().esa < (pf.n - pf.w + 1ULL));
+    }
+
+    inline void print_lcp(buffered_writer &out, int_t val)
+    {
+        if (outputs & LCP)
+            out.write_int(val, THRBYTES);
     }
 
     inline void print_sa()
     {
+        if (!(outputs & SA))
+            return;
+
         if (j < (pf.n - pf.w + 1ULL))
         {
-            size_t pos = j;
-            if (fwrite(&pos, SSABYTES, 1, ssa_file) != 1)
-                error("SA write error 1");
-            if (fwrite(&ssa, SSABYTES, 1, ssa_file) != 1)
-                error("SA write error 2");
+            ssa_file.write_int(j, SSABYTES);
+            ssa_file.write_int(ssa, SSABYTES);
         }
 
         if(j > 0)
         {
-            size_t pos = j-1;
-            if (fwrite(&pos, SSABYTES, 1, esa_file) != 1)
-                error("SA write error 1");
-            if (fwrite(&esa, SSABYTES, 1, esa_file) != 1)
-                error("SA write error 2");
+            esa_file.write_int(j - 1, SSABYTES);
+            esa_file.write_int(esa, SSABYTES);
         }
 
     }
 
     inline void print_bwt()
     {
-        if(length > 0)
+        if(length > 0 && (outputs & BWT))
         {
             if(rle)
             {
                 // Write the head
-                if (fputc(head, bwt_file) == EOF)
-                    error("BWT write error 1");
-                
+                bwt_file.put(head);
                 // Write the length
-                if (fwrite(&length, BWTBYTES, 1, bwt_file_len) != 1)
-                    error("BWT write error 2");
+                bwt_file_len.write_int(length, BWTBYTES);
             }else{
-
-                for(size_t i = 0; i < length; ++i)
-                {
-                    if (fputc(head, bwt_file) == EOF)
-                        error("BWT write error 1");
-                }
-                // uint8_t* run = new uint8_t[length];
-                // memset(run,head,length);
-
-                // if (fwrite(run, 1, length, bwt_file) != length)
-                //     error("BWT write error 1");
-
-                // delete run;
+                bwt_file.fill(head, length);
             }
 
         }
 
     }
 
-    inline void update_bwt(uint8_t next_char, size_t length_)
+    // Gives the current run of BWT_T to the run consumer
+    inline void print_run()
     {
-        if (head != next_char)
+        if (length > 0 && (outputs & RUNS))
+            run_consumer({head, length, run_ssa, esa, run_threshold});
+    }
+
+    inline void update_bwt(chunk_t &ch, uint8_t next_char, size_t length_)
+    {
+        // The first run of the chunk can continue the last run of the previous chunk, this is fixed when merging
+        if (ch.runs.empty() || ch.runs.back().head != next_char)
         {
-            // Print threshold
-            print_threshold(next_char);
-            print_sa();
-            print_bwt();
-
-            head = next_char;
-            // lengths.push_back(0); // Debug only
-            length = 0; // Debug only
             // Create the new min
-            new_min_s(pf.n + 10, j);
+            ch.runs.push_back({next_char, 0, pf.n + 10, ch.j, ch.ssa, 0});
         }
 
-        length += length_;
-        // lengths.back() += length; // Debug only
+        ch.runs.back().length += length_;
     }
 
-    inline void init_first_last_occ()
+    inline void init_first_last_occ(chunk_t &ch)
     {
-        first_occ = pf.n; // First occurrence of same suffix phrases in BWT_P
-        last_occ = 0;     // Last occurrence of same suffix phrases in BWT_P
+        ch.first_occ = pf.n; // First occurrence of same suffix phrases in BWT_P
+        ch.last_occ = 0;     // Last occurrence of same suffix phrases in BWT_P
     }
 
-    inline void update_first_last_occ(phrase_suffix_t &curr) 
+    inline void update_first_last_occ(chunk_t &ch, phrase_suffix_t &curr) 
     {
         size_t begin = pf.pars.select_ilist_s(curr.phrase + 1);
         size_t end = pf.pars.select_ilist_s(curr.phrase + 2) - 1;
 
-        size_t first = pf.pars.ilist[begin];
-        size_t last  = pf.pars.ilist[end];
+        size_t first = pf.pars.ilist_view[begin];
+        size_t last  = pf.pars.ilist_view[end];
 
-        if(first_occ > first)
-            first_occ = first;
+        if(ch.first_occ > first)
+            ch.first_occ = first;
 
-        if(last_occ < last)
-            last_occ = last;
+        if(ch.last_occ < last)
+            ch.last_occ = last;
     }
     
     
-    inline void print_threshold(uint8_t next_char)
+    // Returns the position of the threshold of the run of next_char
+    inline size_t print_threshold(uint8_t next_char)
     {
+        if (!(outputs & (THRESHOLDS | RUNS)))
+            return 0;
 
-        // Update thresholds
-        for (auto character: pf.dict.alphabet)
-        {
-            if (character == head) continue;
-            if (min_s < thresholds[character])
-            {
-                thresholds[character] = min_s;
-                thresholds_pos[character] = pos_s;
-            }
-        }
+        size_t threshold = 0;
+
+        // Update thresholds, ties are won by the earliest position
+        thresholds.update_except(head, {min_s, pos_s});
 
         if (never_seen[next_char])
         {
@@ -482,22 +1034,26 @@ private:
             never_seen[next_char] = false;
 
             // Write a zero so the positions of thresholds and BWT runs are the same
-            size_t zero = 0;
-            if (fwrite(&zero, THRBYTES, 1, thr_file) != 1)
-                error("THR write error 1");
-            if (fwrite(&zero, THRBYTES, 1, thr_pos_file) != 1)
-                error("THR write error 2");
+            if (outputs & THRESHOLDS)
+            {
+                thr_file.write_int(0, THRBYTES);
+                thr_pos_file.write_int(0, THRBYTES);
+            }
         }
         else
         {
-            if (fwrite(&thresholds[next_char], THRBYTES, 1, thr_file) != 1)
-                error("THR write error 3");
-            if (fwrite(&thresholds_pos[next_char], THRBYTES, 1, thr_pos_file) != 1)
-                error("THR write error 4");
+            auto thr = thresholds.get(next_char);
+            if (outputs & THRESHOLDS)
+            {
+                thr_file.write_int(thr.first, THRBYTES);
+                thr_pos_file.write_int(thr.second, THRBYTES);
+            }
+            threshold = thr.second;
         }
 
 
-        thresholds[next_char] = pf.n;
+        thresholds.set(next_char, {pf.n, 0});
+        return threshold;
     }
 };
 
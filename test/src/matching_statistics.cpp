@@ -28,53 +28,232 @@
 
 #include <ms_pointers.hpp>
 #include <pfp_ra.hpp>
+#include <pfp_lce.hpp>
 
 #include <malloc_count.h>
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+
 typedef std::pair<std::string, std::vector<uint8_t>> pattern_t;
 
-std::vector<pattern_t> read_patterns(std::string filename)
+// Streams the patterns of a FASTA or FASTQ file one record at a time.
+class pattern_reader
 {
-  // Open File
-  FILE *fd;
-  if ((fd = fopen(filename.c_str(), "r")) == nullptr)
-    error("open() file " + filename + " failed");
-
-  std::vector<pattern_t> patterns;
+public:
+  pattern_reader(std::string filename)
+  {
+    if ((fd = fopen(filename.c_str(), "r")) == nullptr)
+      error("open() file " + filename + " failed");
+  }
 
-  pattern_t pattern;
+  ~pattern_reader()
+  {
+    fclose(fd);
+  }
 
-  char c;
-  while (fread(&c, sizeof(char), 1, fd) == 1)
+  // Reads the next pattern, returns false at the end of the file.
+  bool next(pattern_t &pattern)
   {
-    if (c == '>')
-    {
-      if (pattern.second.size() > 0)
-        patterns.push_back(pattern);
+    pattern.first.clear();
+    pattern.second.clear();
 
-      pattern.first.clear();
-      pattern.second.clear();
+    int c;
+    // Skip empty lines
+    while ((c = getc(fd)) == '\n' || c == '\r');
+    if (c == EOF)
+      return false;
 
-      pattern.first.append(1, c);
-      while (fread(&c, sizeof(char), 1, fd) == 1 && c != '\n')
+    if (c == '@')
+    {
+      pattern.first.append(1, '>');
+      while ((c = getc(fd)) != EOF && c != '\n')
         pattern.first.append(1, c);
+
+      read_line(pattern.second);
+      // Skip the '+' line and the qualities
+      while ((c = getc(fd)) != EOF && c != '\n');
+      while ((c = getc(fd)) != EOF && c != '\n');
     }
     else
     {
-      pattern.second.push_back(c);
-      while (fread(&c, sizeof(char), 1, fd) == 1 && c != '\n')
-        pattern.second.push_back(c);
+      if (c == '>')
+      {
+        pattern.first.append(1, '>');
+        while ((c = getc(fd)) != EOF && c != '\n')
+          pattern.first.append(1, c);
+      }
+      else
+        ungetc(c, fd);
+
+      // A FASTA sequence may span several lines, and the lines before the first
+      // header are a single pattern with an empty name
+      while ((c = getc(fd)) != EOF && c != '>')
+      {
+        ungetc(c, fd);
+        read_line(pattern.second);
+      }
+      if (c == '>')
+        ungetc(c, fd);
     }
+
+    return true;
   }
 
-  if (pattern.second.size() > 0)
-    patterns.push_back(pattern);
+private:
+  FILE *fd;
+
+  void read_line(std::vector<uint8_t> &seq)
+  {
+    int c;
+    while ((c = getc(fd)) != EOF && c != '\n')
+      if (c != '\r')
+        seq.push_back(c);
+  }
+};
+
+// Blocking FIFO queue with a maximum capacity.
+template <typename T>
+class bounded_queue
+{
+public:
+  bounded_queue(size_t capacity_) : capacity(capacity_) {}
+
+  // Blocks while the queue is full.
+  void push(T &&elem)
+  {
+    std::unique_lock<std::mutex> lock(m);
+    not_full.wait(lock, [this] { return q.size() < capacity; });
+    q.push_back(std::move(elem));
+    not_empty.notify_one();
+  }
+
+  // Blocks while the queue is empty, returns false once the queue is closed and drained.
+  bool pop(T &elem)
+  {
+    std::unique_lock<std::mutex> lock(m);
+    not_empty.wait(lock, [this] { return !q.empty() || closed; });
+    if (q.empty())
+      return false;
+    elem = std::move(q.front());
+    q.pop_front();
+    not_full.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    std::unique_lock<std::mutex> lock(m);
+    closed = true;
+    not_empty.notify_all();
+  }
+
+private:
+  size_t capacity;
+  bool closed = false;
+  std::deque<T> q;
+  std::mutex m;
+  std::condition_variable not_full;
+  std::condition_variable not_empty;
+};
+
+// A batch of consecutive patterns, tagged with its position in the input.
+typedef struct
+{
+  size_t id = 0;
+  std::vector<pattern_t> patterns;
+  std::string pointers;
+  std::string lengths;
+} batch_t;
+
+// Writes the batches in input order, whatever order the workers complete them.
+class ordered_writer
+{
+public:
+  ordered_writer(std::ofstream &f_pointers_, std::ofstream &f_lengths_, size_t window_) : f_pointers(f_pointers_),
+                                                                                         f_lengths(f_lengths_),
+                                                                                         window(window_)
+  {
+  }
+
+  // Blocks while the batch is more than window batches ahead of the next one to write.
+  void write(batch_t &&batch)
+  {
+    std::unique_lock<std::mutex> lock(m);
+    in_window.wait(lock, [this, &batch] { return batch.id < next_id + window; });
+    pending.emplace(batch.id, std::move(batch));
+    // Flush all the batches that are ready
+    auto it = pending.begin();
+    while (it != pending.end() && it->first == next_id)
+    {
+      f_pointers << it->second.pointers;
+      f_lengths << it->second.lengths;
+      it = pending.erase(it);
+      next_id++;
+    }
+    in_window.notify_all();
+  }
+
+private:
+  std::ofstream &f_pointers;
+  std::ofstream &f_lengths;
+  size_t window;
+  std::map<size_t, batch_t> pending;
+  size_t next_id = 0;
+  std::mutex m;
+  std::condition_variable in_window;
+};
+
+// Without lce the lengths are computed reading the text from ra
+template <typename ms_t, typename ra_t>
+void process_batch(ms_t &ms, ra_t &ra, const pfp_lce<ra_t> *lce, batch_t &batch)
+{
+  std::stringstream ss_pointers;
+  std::stringstream ss_lengths;
+
+  for (auto &pattern : batch.patterns)
+  {
+    auto pointers = ms.query(pattern.second);
+    std::vector<size_t> lengths(pointers.size());
+    std::unique_ptr<typename pfp_lce<ra_t>::query> query;
+    if (lce != nullptr)
+      query.reset(new typename pfp_lce<ra_t>::query(pattern.second.data(), pattern.second.size()));
+    size_t l = 0;
+    for (size_t i = 0; i < pointers.size(); ++i)
+    {
+      size_t pos = pointers[i];
+      if (lce != nullptr)
+        l += lce->match_length(pos + l, *query, i + l);
+      else
+        l += ra.match_length(pos + l, (const uint8_t *)pattern.second.data() + i + l, pattern.second.size() - (i + l));
+
+      lengths[i] = l;
+      l = (l == 0 ? 0 : (l - 1));
+    }
 
-  fclose(fd);
+    ss_pointers << pattern.first << endl;
+    for (auto elem : pointers)
+      ss_pointers << elem << " ";
+    ss_pointers << endl;
+
+    ss_lengths << pattern.first << endl;
+    for (auto elem : lengths)
+      ss_lengths << elem << " ";
+    ss_lengths << endl;
+  }
 
-  return patterns;
+  batch.patterns.clear();
+  batch.patterns.shrink_to_fit();
+  batch.pointers = ss_pointers.str();
+  batch.lengths = ss_lengths.str();
 }
 
+const size_t batch_size = 256;       // Number of patterns in a batch
+const size_t batches_per_thread = 4; // Capacity of the input queue per worker thread
+
 int main(int argc, char *const argv[])
 {
 
@@ -86,7 +265,17 @@ int main(int argc, char *const argv[])
   verbose("Building the matching statistics index");
   std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
 
-  ms_pointers<> ms(args.filename);
+  // Map the stored index if it is up to date with the thresholds
+  std::unique_ptr<ms_pointers<>> ms_ptr(new ms_pointers<>());
+  bool mapped = is_newer(args.filename + ms_ptr->filesuffix(), args.filename + ".thr_pos");
+  if (mapped)
+  {
+    verbose("Loading ", args.filename + ms_ptr->filesuffix());
+    ms_ptr->load_mapped(args.filename + ms_ptr->filesuffix());
+  }
+  else
+    ms_ptr.reset(new ms_pointers<>(args.filename, false, args.th));
+  ms_pointers<> &ms = *ms_ptr;
 
   std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
@@ -99,19 +288,16 @@ int main(int argc, char *const argv[])
 
   pfp_ra ra(args.filename, args.w);
 
-  t_insert_end = std::chrono::high_resolution_clock::now();
-
-  verbose("Matching statistics index construction complete");
-  verbose("Memory peak: ", malloc_count_peak());
-  verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
-
-  verbose("Reading patterns");
-  t_insert_start = std::chrono::high_resolution_clock::now();
-
-  std::vector<pattern_t> patterns = read_patterns(args.patterns);
+  std::unique_ptr<pfp_lce<pfp_ra>> lce;
+  if (args.lce)
+  {
+    lce.reset(new pfp_lce<pfp_ra>(ra));
+    verbose("Fingerprints size (bytes): ", lce->size_in_bytes());
+  }
 
   t_insert_end = std::chrono::high_resolution_clock::now();
 
+  verbose("Matching statistics index construction complete");
   verbose("Memory peak: ", malloc_count_peak());
   verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
 
@@ -127,31 +313,47 @@ int main(int argc, char *const argv[])
   if (!f_lengths.is_open())
     error("open() file " + std::string(args.filename) + ".lengths failed");
 
-  for (auto pattern : patterns)
+  size_t n_threads = std::max(args.th, size_t(1));
+  verbose("Number of threads: ", n_threads);
+
+  bounded_queue<batch_t> queue(n_threads * batches_per_thread);
+  ordered_writer writer(f_pointers, f_lengths, n_threads * batches_per_thread);
+
+  // The workers share the read-only index and random access structures
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < n_threads; ++t)
+    workers.emplace_back([&]() {
+      batch_t batch;
+      while (queue.pop(batch))
+      {
+        process_batch(ms, ra, lce.get(), batch);
+        writer.write(std::move(batch));
+      }
+    });
+
+  // Stream the patterns in batches
+  pattern_reader reader(args.patterns);
+  batch_t batch;
+  pattern_t pattern;
+  while (reader.next(pattern))
   {
-    auto pointers = ms.query(pattern.second);
-    std::vector<size_t> lengths(pointers.size());
-    size_t l = 0;
-    for (size_t i = 0; i < pointers.size(); ++i)
+    if (pattern.second.size() == 0)
+      continue;
+    batch.patterns.push_back(std::move(pattern));
+    if (batch.patterns.size() == batch_size)
     {
-      size_t pos = pointers[i];
-      while ((i + l) < pattern.second.size() && (pos + l) < ra.n && pattern.second[i + l] == ra.charAt(pos + l))
-        ++l;
-
-      lengths[i] = l;
-      l = (l == 0 ? 0 : (l - 1));
+      size_t id = batch.id;
+      queue.push(std::move(batch));
+      batch = batch_t();
+      batch.id = id + 1;
     }
-
-    f_pointers << pattern.first << endl;
-    for (auto elem : pointers)
-      f_pointers << elem << " ";
-    f_pointers << endl;
-
-    f_lengths << pattern.first << endl;
-    for (auto elem : lengths)
-      f_lengths << elem << " ";
-    f_lengths << endl;
   }
+  if (batch.patterns.size() > 0)
+    queue.push(std::move(batch));
+  queue.close();
+
+  for (auto &worker : workers)
+    worker.join();
 
   f_pointers.close();
   f_lengths.close();
@@ -170,8 +372,14 @@ int main(int argc, char *const argv[])
     verbose("Thresholds size (bytes): ", space);
   }
 
-  if (args.store)
+  if (args.store and not mapped)
   {
+    std::string outfile = args.filename + ms.filesuffix();
+    std::ofstream out(outfile, std::ios::binary);
+    if (!out)
+      error("open() file " + outfile + " failed");
+    ms.serialize_mapped(out);
+    verbose("Index stored in ", outfile);
   }
 
   if (args.csv)
@@ -130,8 +130,7 @@ int main(int argc, char *const argv[])
       for (size_t i = 0; i < pointers.size(); ++i)
       {
         size_t pos = pointers[i];
-        while ((i + l) < pattern.second.size() && (pos + l) < ra.n && pattern.second[i + l] == ra.charAt(pos + l))
-          ++l;
+        l += ra.match_length(pos + l, (const uint8_t *)pattern.second.data() + i + l, pattern.second.size() - (i + l));
 
         lengths[i] = l;
         l = (l == 0 ? 0 : (l - 1));
@@ -108,8 +108,117 @@ protected:
 
     // You can define per-test tear-down logic as usual.
     virtual void TearDown() {}
+
+    // Checks that bwt and bwt1 have the same characters, and the same answers to rank
+    // and select, on Max_Sampling_Size positions of each kind evenly spaced
+    static void compare(ms_rle_string<> &bwt, ms_rle_string<> &bwt1, size_t Max_Sampling_Size = 10000)
+    {
+        ASSERT_EQ(bwt.size(), bwt1.size());
+        EXPECT_EQ(bwt.number_of_runs(), bwt1.number_of_runs());
+
+        const size_t n = bwt.size();
+        const size_t step = std::max(size_t(1), n / Max_Sampling_Size);
+        for (size_t i = 0; i < n; i += step)
+            EXPECT_EQ(bwt[i], bwt1[i]) << "At position: " << i;
+
+        for (size_t c = 0; c < 256; ++c)
+        {
+            size_t occ = bwt.number_of_letter(c);
+            EXPECT_EQ(occ, bwt1.number_of_letter(c)) << "Character: " << c;
+            if (occ == 0 or occ != bwt1.number_of_letter(c))
+                continue;
+
+            for (size_t i = 0; i < n; i += step)
+                EXPECT_EQ(bwt.rank(i, c), bwt1.rank(i, c)) << "At position: " << i << " Character: " << c;
+            EXPECT_EQ(bwt.rank(n, c), bwt1.rank(n, c)) << "Character: " << c;
+
+            const size_t occ_step = std::max(size_t(1), occ / Max_Sampling_Size);
+            for (size_t j = 0; j < occ; j += occ_step)
+                EXPECT_EQ(bwt.select(j, c), bwt1.select(j, c)) << "At occurrence: " << j << " Character: " << c;
+            EXPECT_EQ(bwt.select(occ - 1, c), bwt1.select(occ - 1, c)) << "Character: " << c;
+        }
+    }
+
+    // Writes the runs of bwt_s in the format of infile.bwt.heads and infile.bwt.len, and
+    // returns the run heads and the run lengths
+    static void write_runs(const std::string &bwt_s, std::string bwt_fname, std::string &heads, sdsl::int_vector<> &lengths)
+    {
+        std::vector<size_t> lengths_v;
+        heads.clear();
+        for (size_t i = 0; i < bwt_s.size(); ++i)
+        {
+            if (i == 0 or bwt_s[i] != bwt_s[i - 1])
+            {
+                heads.push_back(bwt_s[i]);
+                lengths_v.push_back(0);
+            }
+            lengths_v.back()++;
+        }
+        lengths = sdsl::int_vector<>(lengths_v.size(), 0, 64);
+        for (size_t i = 0; i < lengths_v.size(); ++i)
+            lengths[i] = lengths_v[i];
+
+        std::ofstream out_heads(bwt_fname + ".heads", std::ios::binary);
+        out_heads.write(heads.data(), heads.size());
+        std::ofstream out_len(bwt_fname + ".len", std::ios::binary);
+        for (auto length : lengths_v)
+            out_len.write((const char *)&length, 5);
+    }
+};
+
+// Exposes the layout of the files written by ms_pointers::serialize_mapped()
+class ms_pointers_layout : public ms_pointers<>
+{
+public:
+    using ms_pointers<>::header_t;
+    using ms_pointers<>::F_SECTION;
 };
 
+// The F column and the terminator position stored by serialize_mapped()
+static std::vector<ulint> stored_F(ms_pointers<> &ms, ulint &terminator_position)
+{
+    std::stringstream ss;
+    ms.serialize_mapped(ss);
+    const std::string data = ss.str();
+
+    ms_pointers_layout::header_t header;
+    memcpy(&header, data.data(), sizeof(header));
+    terminator_position = header.terminator_position;
+
+    const auto &section = header.sections[ms_pointers_layout::F_SECTION];
+    std::vector<ulint> F(section.size);
+    memcpy(F.data(), data.data() + section.offset, section.bytes);
+    return F;
+}
+
+// The F column as computed from the plain BWT by r_index::build_F, before it was
+// computed from the run-length encoded BWT
+static std::vector<ulint> build_F(std::ifstream &ifs, ulint &terminator_position)
+{
+    ifs.clear();
+    ifs.seekg(0);
+    std::vector<ulint> F(256, 0);
+    int c;
+    ulint i = 0;
+    while ((c = ifs.get()) != EOF)
+    {
+        if (c > TERMINATOR)
+            F[c]++;
+        else
+        {
+            F[TERMINATOR]++;
+            terminator_position = i;
+        }
+        i++;
+    }
+    for (ulint i = 255; i > 0; --i)
+        F[i] = F[i - 1];
+    F[0] = 0;
+    for (ulint i = 1; i < 256; ++i)
+        F[i] += F[i - 1];
+    return F;
+}
+
 
 
 TEST_F(MS_RLE_String_Test, RLBWT)
@@ -140,6 +249,197 @@ TEST_F(MS_RLE_String_Test, RLBWT)
     }
 }
 
+TEST_F(MS_RLE_String_Test, RUNS)
+{
+    std::string bwt_fname = test_file + ".bwt";
+
+    TEST_COUT << "Construction from plain bwt" << std::endl;
+    std::ifstream ifs(bwt_fname);
+    ms_rle_string<> bwt(ifs);
+
+    // The construction of rle_string expands the runs in bitvectors
+    TEST_COUT << "Construction from string" << std::endl;
+    std::ifstream ifs_s(bwt_fname);
+    std::string bwt_s((std::istreambuf_iterator<char>(ifs_s)), std::istreambuf_iterator<char>());
+    for (auto &c : bwt_s)
+        if ((uchar)c <= TERMINATOR)
+            c = TERMINATOR;
+    ms_rle_string<> bwt1(bwt_s);
+
+    compare(bwt, bwt1);
+}
+
+TEST_F(MS_RLE_String_Test, THREADS)
+{
+    std::string bwt_fname = test_file + ".bwt";
+
+    TEST_COUT << "Construction from plain bwt" << std::endl;
+    std::ifstream ifs(bwt_fname);
+    ms_rle_string<> bwt(ifs);
+
+    std::string bwt_heads_fname = bwt_fname + ".heads";
+    std::ifstream ifs_heads(bwt_heads_fname);
+    std::string bwt_len_fname = bwt_fname + ".len";
+    std::ifstream ifs_len(bwt_len_fname);
+
+    for (size_t n_threads : {2, 4, 16})
+    {
+        TEST_COUT << "Construction from plain bwt with " << n_threads << " threads" << std::endl;
+        ms_rle_string<> bwt1(ifs, 2, n_threads);
+        compare(bwt, bwt1);
+
+        TEST_COUT << "Construction from rle bwt with " << n_threads << " threads" << std::endl;
+        ms_rle_string<> bwt2(ifs_heads, ifs_len, 2, n_threads);
+        compare(bwt, bwt2);
+    }
+}
+
+// The plain bwt is read in blocks of 1 MiB
+TEST_F(MS_RLE_String_Test, LARGE)
+{
+    // Runs of up to 64 characters, with a run across the end of the first block
+    srand(0);
+    std::string bwt_s;
+    const size_t n = (3 << 20) + 12345;
+    while (bwt_s.size() < n)
+    {
+        char c = "ACGT"[rand() % 4];
+        size_t length = 1 + rand() % 64;
+        if (bwt_s.size() < (1 << 20) and bwt_s.size() + length >= (1 << 20))
+            length += 1000;
+        bwt_s.append(std::min(length, n - bwt_s.size()), c);
+    }
+    bwt_s[n / 2] = 0; // The terminator
+
+    std::string bwt_fname = test_file + ".large.bwt";
+    {
+        std::ofstream out(bwt_fname, std::ios::binary);
+        out.write(bwt_s.data(), bwt_s.size());
+    }
+
+    TEST_COUT << "Construction from plain bwt" << std::endl;
+    std::ifstream ifs(bwt_fname);
+    ms_rle_string<> bwt(ifs);
+    EXPECT_EQ(bwt.size(), n);
+
+    TEST_COUT << "Construction from plain bwt with 4 threads" << std::endl;
+    ms_rle_string<> bwt1(ifs, 2, 4);
+    compare(bwt, bwt1);
+
+    TEST_COUT << "Construction from string" << std::endl;
+    bwt_s[n / 2] = TERMINATOR;
+    ms_rle_string<> bwt2(bwt_s);
+    compare(bwt, bwt2);
+
+    ifs.close();
+    std::remove(bwt_fname.c_str());
+}
+
+TEST_F(MS_RLE_String_Test, IN_MEMORY)
+{
+    std::string bwt_fname = test_file + ".bwt";
+
+    TEST_COUT << "Construction from plain bwt" << std::endl;
+    std::ifstream ifs(bwt_fname);
+    ms_rle_string<> bwt(ifs);
+
+    TEST_COUT << "Construction from run heads and lengths in memory" << std::endl;
+    std::ifstream ifs_heads(bwt_fname + ".heads");
+    std::string heads((std::istreambuf_iterator<char>(ifs_heads)), std::istreambuf_iterator<char>());
+    std::ifstream ifs_len(bwt_fname + ".len");
+    sdsl::int_vector<> lengths(heads.size(), 0, 64);
+    for (size_t i = 0; i < heads.size(); ++i)
+    {
+        size_t length = 0;
+        ifs_len.read((char *)&length, 5);
+        lengths[i] = length;
+    }
+    std::string heads2 = heads;
+    ms_rle_string<> bwt1(heads, lengths);
+    compare(bwt, bwt1);
+
+    TEST_COUT << "Construction from run heads and lengths in memory with 4 threads" << std::endl;
+    ms_rle_string<> bwt2(heads2, lengths, 2, 4);
+    compare(bwt, bwt2);
+}
+
+// Characters above 127 are negative as char, and must not be taken for the terminator
+TEST_F(MS_RLE_String_Test, HIGH_HEADS)
+{
+    srand(0);
+    std::string bwt_s;
+    const size_t n = 100000;
+    while (bwt_s.size() < n)
+    {
+        char c = (char)(2 + rand() % 254);
+        size_t length = 1 + rand() % 16;
+        bwt_s.append(std::min(length, n - bwt_s.size()), c);
+    }
+    bwt_s[n / 2] = 0; // The terminator
+
+    std::string bwt_fname = test_file + ".high.bwt";
+    {
+        std::ofstream out(bwt_fname, std::ios::binary);
+        out.write(bwt_s.data(), bwt_s.size());
+    }
+    std::string heads;
+    sdsl::int_vector<> lengths;
+    write_runs(bwt_s, bwt_fname, heads, lengths);
+
+    TEST_COUT << "Construction from plain bwt" << std::endl;
+    std::ifstream ifs(bwt_fname);
+    ms_rle_string<> bwt(ifs);
+    ASSERT_EQ(bwt.size(), n);
+
+    std::vector<size_t> occ(256, 0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        uchar c = std::max((uchar)bwt_s[i], (uchar)TERMINATOR);
+        occ[c]++;
+        EXPECT_EQ(bwt[i], c) << "At position: " << i;
+    }
+    for (size_t c = 0; c < 256; ++c)
+        EXPECT_EQ(bwt.number_of_letter(c), occ[c]) << "Character: " << c;
+
+    TEST_COUT << "Construction from rle bwt" << std::endl;
+    std::ifstream ifs_heads(bwt_fname + ".heads");
+    std::ifstream ifs_len(bwt_fname + ".len");
+    ms_rle_string<> bwt1(ifs_heads, ifs_len);
+    compare(bwt, bwt1);
+
+    TEST_COUT << "Construction from run heads and lengths in memory" << std::endl;
+    ms_rle_string<> bwt2(heads, lengths, 2, 4);
+    compare(bwt, bwt2);
+
+    ifs.close();
+    ifs_heads.close();
+    ifs_len.close();
+    for (std::string suffix : {"", ".heads", ".len"})
+        std::remove((bwt_fname + suffix).c_str());
+}
+
+TEST_F(MS_RLE_String_Test, BUILD_F)
+{
+    std::string bwt_fname = test_file + ".bwt";
+
+    std::ifstream ifs(bwt_fname);
+    ulint terminator_position = 0;
+    std::vector<ulint> F = build_F(ifs, terminator_position);
+
+    for (bool rle : {false, true})
+    {
+        TEST_COUT << "Construction from " << (rle ? "rle" : "plain") << " bwt" << std::endl;
+        ms_pointers<> ms(test_file, rle);
+
+        ulint ms_terminator_position = 0;
+        std::vector<ulint> ms_F = stored_F(ms, ms_terminator_position);
+        EXPECT_EQ(ms_terminator_position, terminator_position);
+        ASSERT_EQ(ms_F.size(), F.size());
+        for (size_t c = 0; c < F.size(); ++c)
+            EXPECT_EQ(ms_F[c], F[c]) << "Character: " << c;
+    }
+}
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -32,7 +32,8 @@
 #include <sdsl/io.hpp>
 
 #include <pfp.hpp>
-#include <pfp_lcp.hpp>
+#include <kr_parser.hpp>
+#include <pfp_thresholds.hpp>
 
 #include <malloc_count.h>
 
@@ -42,21 +43,48 @@ int main(int argc, char* const argv[]) {
   Args args;
   parseArgs(argc, argv, args);
 
-  // TODO: Include cmd line option to load from file/compute
-  // verbose("Loading PFP data structures from file");
-  // std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
-
-  // pf_parsing<> pf;
-  // std::string filename = args.filename + pf.filesuffix();
-  // sdsl::load_from_file(pf, filename);
-
   // Computing prefix-free parsing
   verbose("Window size set to: " , args.w);
 
   verbose("Computing PFP data structures");
   std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
 
-  pf_parsing pf(args.filename, args.w);
+  // Map the stored data structures if they are up to date with the parsing
+  std::unique_ptr<pf_parsing> pf_ptr(new pf_parsing());
+  std::string pf_filename = args.filename + pf_ptr->filesuffix();
+  bool mapped = (args.parse ? is_newer(pf_filename, args.filename)
+                            : is_newer(pf_filename, args.filename + ".dict") and is_newer(pf_filename, args.filename + ".parse"));
+  if (mapped)
+  {
+    verbose("Loading ", pf_filename);
+    if (not pf_ptr->load_mapped(pf_filename))
+    {
+      warning("invilid file " + pf_filename + ", rebuilding");
+      mapped = false;
+    }
+    else if (pf_ptr->w != args.w)
+    {
+      verbose("The window size of ", pf_filename, " is ", pf_ptr->w, ", rebuilding");
+      mapped = false;
+    }
+  }
+
+  if (not mapped and args.parse)
+  {
+    // The dictionary and the parse are handed over without writing them to disk
+    kr_parser parser(args.filename, args.w, args.mod, args.is_fasta, args.th);
+    pf_ptr.reset(new pf_parsing(parser.d, parser.p, parser.freq, args.w, args.th, args.budget << 20, args.filename, args.memo));
+  }
+  else if (not mapped)
+    pf_ptr.reset(new pf_parsing(args.filename, args.w, args.th, args.budget << 20, args.memo));
+  pf_parsing &pf = *pf_ptr;
+
+  // Stored before the scan, so that a run stopped in the scan does not build them again
+  if (args.store and not mapped)
+  {
+    write_file_atomically(pf_filename, [&](std::ostream &out) { pf.serialize_mapped(out); });
+    verbose("PFP data structures stored in ", pf_filename);
+  }
 
   std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
@@ -72,7 +100,9 @@ int main(int argc, char* const argv[]) {
   verbose("Building the LCP");
 
   
-  pfp_lcp lcp(pf, args.filename);
+  // The same scan of the thresholds, restricted to the LCP, SA samples, and BWT
+  pfp_thresholds lcp(pf, args.filename, args.rle, args.th,
+                     pfp_thresholds::LCP | pfp_thresholds::SA | pfp_thresholds::BWT, args.checkpoint);
 
   auto mem_peak = malloc_count_peak();
   verbose("Memory peak: ", malloc_count_peak());
@@ -91,7 +91,17 @@ int main(int argc, char* const argv[]) {
   std::chrono::high_resolution_clock::time_point t_start = std::chrono::high_resolution_clock::now();
   std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
   
-  ms_pointers<> ms(args.filename);
+  // Map the stored index if it is up to date with the thresholds
+  std::unique_ptr<ms_pointers<>> ms_ptr(new ms_pointers<>());
+  bool mapped = is_newer(args.filename + ms_ptr->filesuffix(), args.filename + ".thr_pos");
+  if (mapped)
+  {
+    verbose("Loading ", args.filename + ms_ptr->filesuffix());
+    ms_ptr->load_mapped(args.filename + ms_ptr->filesuffix());
+  }
+  else
+    ms_ptr.reset(new ms_pointers<>(args.filename, false, args.th));
+  ms_pointers<> &ms = *ms_ptr;
 
   std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
@@ -124,6 +134,7 @@ int main(int argc, char* const argv[]) {
   size_t ra_size = sdsl::size_in_bytes(ra);
 
   verbose("MS size (bytes): ", ms_size);
+  verbose("MS thresholds size (bytes): ", ms.thresholds_size_in_bytes());
   verbose("RA size (bytes): ", ra_size);
 
 
@@ -135,9 +146,14 @@ int main(int argc, char* const argv[]) {
   }
 
   
-  if (args.store)
+  if (args.store and not mapped)
   {
-
+    std::string outfile = args.filename + ms.filesuffix();
+    std::ofstream out(outfile, std::ios::binary);
+    if (!out)
+      error("open() file " + outfile + " failed");
+    ms.serialize_mapped(out);
+    verbose("Index stored in ", outfile);
   }
 
   if (args.csv)
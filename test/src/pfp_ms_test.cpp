@@ -36,6 +36,9 @@
 #include <ms_w.hpp>
 #include <pfp_ms_w.hpp>
 #include <sdsl_ms_w.hpp>
+#include <pfp_lce.hpp>
+#include <pfp.hpp>
+#include <pfp_thresholds.hpp>
 
 extern "C" {
     #include<gsacak.h>
@@ -206,6 +209,57 @@ protected:
         }
     }
 
+    // Positions to test the random access on: random positions, positions just before the
+    // beginning of a random phrase, so that len characters cross it, and the last len
+    // positions of the text, from which it wraps around cyclically.
+    template <typename ra_t>
+    static std::vector<size_t> sample_positions(size_t Max_Sampling_Size, size_t seed, const ra_t *ra, size_t len)
+    {
+        srand(seed);
+        const size_t n = ra->n;
+        len = std::min(len, n);
+        std::vector<size_t> positions;
+
+        for (size_t i = 0; i < Max_Sampling_Size; ++i)
+        {
+            positions.push_back(rand() % n);
+
+            // Phrase k begins in select_b_p(k + 1) after the cyclic shift by w, p ends with a 0
+            size_t phrase = rand() % (ra->p.size() - 1);
+            size_t begin = (ra->select_b_p(phrase + 1) + n - ra->w) % n;
+            positions.push_back((begin + n - 1 - rand() % len) % n);
+        }
+
+        for (size_t k = 1; k <= len; ++k)
+            positions.push_back(n - k);
+
+        return positions;
+    }
+
+    // Length of the match of pattern[i, m) with the text in pos, one character at a time
+    template <typename ra_t>
+    static size_t naive_match_length(const ra_t *ra, uint64_t pos, const query_t &pattern, size_t i)
+    {
+        const size_t m = pattern.size();
+        size_t l = 0;
+        while ((i + l) < m && (pos + l) < ra->n && pattern[i + l] == ra->charAt(pos + l))
+            ++l;
+        return l;
+    }
+
+    // A pattern whose suffix starting in i is the text starting in pos, up to a random
+    // mismatch if mismatch is true
+    static query_t matching_pattern(const pfp_ra *ra, uint64_t pos, size_t i, size_t m, bool mismatch)
+    {
+        query_t pattern(m);
+        for (size_t k = 0; k < i; ++k)
+            pattern[k] = ra->charAt(rand() % ra->n);
+        ra->extract(pos, m - i, pattern.data() + i);
+        if (mismatch and m > i)
+            pattern[i + rand() % (m - i)]++;
+        return pattern;
+    }
+
     // Some expensive resource shared by all tests.
     static const size_t w = 10;
     static ms_pointers<>* ms;
@@ -253,6 +307,138 @@ TEST_F(PFP_CST_Test, CHILD)
     }
 }
 
+TEST_F(PFP_CST_Test, EXTRACT)
+{
+    for (auto q : Query::All)
+    {
+        auto &l = Query::Lengths[q].first;
+        for (size_t pos : sample_positions(100, l, ra, l))
+        {
+            std::string res = ra->extract(pos, l);
+            ASSERT_EQ(res.size(), l);
+            for (size_t k = 0; k < l; ++k)
+                EXPECT_EQ((uint8_t)res[k], ra->charAt(pos + k)) << "At position: " << pos << " offset: " << k;
+        }
+    }
+}
+
+TEST_F(PFP_CST_Test, MATCH_LENGTH)
+{
+    for (auto q : Query::All)
+    {
+        auto &l = Query::Lengths[q].first;
+        for (size_t pos : sample_positions(100, l, ra, l))
+        {
+            for (bool mismatch : {false, true})
+            {
+                size_t i = rand() % (l / 2);
+                query_t pattern = matching_pattern(ra, pos, i, l, mismatch);
+                EXPECT_EQ(ra->match_length(pos, pattern.data() + i, l - i), naive_match_length(ra, pos, pattern, i))
+                    << "At position: " << pos << " i: " << i;
+            }
+        }
+
+        // The samples are unrelated to the text in pos
+        for (const auto &pattern : (*samples)[q])
+        {
+            size_t pos = rand() % ra->n;
+            EXPECT_EQ(ra->match_length(pos, pattern.data(), pattern.size()), naive_match_length(ra, pos, pattern, 0))
+                << "At position: " << pos;
+        }
+
+        query_t pattern = matching_pattern(ra, 0, 0, l, false);
+        EXPECT_EQ(ra->match_length(ra->n, pattern.data(), l), 0);
+    }
+}
+
+TEST_F(PFP_CST_Test, RA_SD_BV)
+{
+    pfp_ra_bv ra_bv(test_file, w);
+    EXPECT_EQ(ra_bv.n, ra->n);
+
+    // Round trip through serialize and load
+    std::stringstream ss;
+    ra_bv.serialize(ss);
+    pfp_ra_bv ra_bv_loaded;
+    ra_bv_loaded.load(ss);
+
+    for (auto q : Query::All)
+    {
+        auto &l = Query::Lengths[q].first;
+        for (size_t pos : sample_positions(100, l, ra, l))
+        {
+            EXPECT_EQ(ra_bv.charAt(pos), ra->charAt(pos)) << "At position: " << pos;
+            EXPECT_EQ(ra_bv_loaded.charAt(pos), ra->charAt(pos)) << "At position: " << pos;
+
+            std::string res = ra->extract(pos, l);
+            EXPECT_EQ(ra_bv.extract(pos, l), res) << "At position: " << pos;
+            EXPECT_EQ(ra_bv_loaded.extract(pos, l), res) << "At position: " << pos;
+        }
+    }
+}
+
+TEST_F(PFP_CST_Test, LCE)
+{
+    pfp_lce<pfp_ra> lce(*ra);
+
+    // Matches longer than the ones compared directly by pfp_lce use the fingerprints
+    for (size_t l : {10, 300, 1000, 5000})
+    {
+        for (size_t pos : sample_positions(100, l, ra, l))
+        {
+            for (bool mismatch : {false, true})
+            {
+                size_t i = rand() % (l / 2);
+                query_t pattern = matching_pattern(ra, pos, i, l, mismatch);
+                pfp_lce<pfp_ra>::query query(pattern.data(), pattern.size());
+                EXPECT_EQ(lce.match_length(pos, query, i), ra->match_length(pos, pattern.data() + i, l - i))
+                    << "At position: " << pos << " i: " << i << " length: " << l;
+            }
+        }
+    }
+
+    for (auto q : Query::All)
+    {
+        for (const auto &pattern : (*samples)[q])
+        {
+            size_t pos = rand() % ra->n;
+            pfp_lce<pfp_ra>::query query(pattern.data(), pattern.size());
+            EXPECT_EQ(lce.match_length(pos, query, 0), ra->match_length(pos, pattern.data(), pattern.size()))
+                << "At position: " << pos;
+        }
+    }
+}
+
+// The index built from the runs given by pfp_thresholds is the same as the one built
+// from the files written by pfp_thresholds
+TEST_F(PFP_CST_Test, RUNS)
+{
+    TEST_COUT << "Building the index from the runs of pfp_thresholds" << std::endl;
+    pf_parsing pf(test_file, w);
+    ms_pointers<>::builder index(pf.n - pf.w + 1);
+    pfp_thresholds thr(pf, test_file, false, 1, pfp_thresholds::RUNS, 0,
+                       [&](const pfp_thresholds::bwt_run_t &run) {
+                           index.push(run.head, run.length, run.ssa, run.esa, run.threshold);
+                       });
+    ms_pointers<> ms_runs(index, 4);
+
+    std::stringstream ss;
+    ms->serialize_mapped(ss);
+    std::stringstream ss_runs;
+    ms_runs.serialize_mapped(ss_runs);
+    EXPECT_TRUE(ss.str() == ss_runs.str());
+
+    for (auto q : Query::All)
+        for (const auto &query : (*samples)[q])
+        {
+            auto pointers = ms->query(query);
+            auto pointers_runs = ms_runs.query(query);
+            ASSERT_EQ(pointers.size(), pointers_runs.size());
+            for (size_t i = 0; i < pointers.size(); ++i)
+                EXPECT_EQ(pointers[i], pointers_runs[i]) << "At position: " << i;
+        }
+}
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
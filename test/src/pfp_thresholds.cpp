@@ -32,8 +32,9 @@
 #include <sdsl/io.hpp>
 
 #include <pfp.hpp>
+#include <kr_parser.hpp>
 #include <pfp_thresholds.hpp>
-// #include <pfp_lcp.hpp>
+#include <ms_pointers.hpp>
 
 #include <malloc_count.h>
 
@@ -43,21 +44,48 @@ int main(int argc, char* const argv[]) {
   Args args;
   parseArgs(argc, argv, args);
 
-  // TODO: Include cmd line option to load from file/compute
-  // verbose("Loading PFP data structures from file");
-  // std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
-
-  // pf_parsing<> pf;
-  // std::string filename = args.filename + pf.filesuffix();
-  // sdsl::load_from_file(pf, filename);
-
   // Computing prefix-free parsing
   verbose("Window size set to: " , args.w);
 
   verbose("Computing PFP data structures");
   std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
 
-  pf_parsing pf(args.filename, args.w);
+  // Map the stored data structures if they are up to date with the parsing
+  std::unique_ptr<pf_parsing> pf_ptr(new pf_parsing());
+  std::string pf_filename = args.filename + pf_ptr->filesuffix();
+  bool mapped = (args.parse ? is_newer(pf_filename, args.filename)
+                            : is_newer(pf_filename, args.filename + ".dict") and is_newer(pf_filename, args.filename + ".parse"));
+  if (mapped)
+  {
+    verbose("Loading ", pf_filename);
+    if (not pf_ptr->load_mapped(pf_filename))
+    {
+      warning("invilid file " + pf_filename + ", rebuilding");
+      mapped = false;
+    }
+    else if (pf_ptr->w != args.w)
+    {
+      verbose("The window size of ", pf_filename, " is ", pf_ptr->w, ", rebuilding");
+      mapped = false;
+    }
+  }
+
+  if (not mapped and args.parse)
+  {
+    // The dictionary and the parse are handed over without writing them to disk
+    kr_parser parser(args.filename, args.w, args.mod, args.is_fasta, args.th);
+    pf_ptr.reset(new pf_parsing(parser.d, parser.p, parser.freq, args.w, args.th, args.budget << 20, args.filename, args.memo));
+  }
+  else if (not mapped)
+    pf_ptr.reset(new pf_parsing(args.filename, args.w, args.th, args.budget << 20, args.memo));
+  pf_parsing &pf = *pf_ptr;
+
+  // Stored before the scan, so that a run stopped in the scan does not build them again
+  if (args.store and not mapped)
+  {
+    write_file_atomically(pf_filename, [&](std::ostream &out) { pf.serialize_mapped(out); });
+    verbose("PFP data structures stored in ", pf_filename);
+  }
 
   std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
@@ -73,7 +101,37 @@ int main(int argc, char* const argv[]) {
 
   // This code gets timed
 
-  pfp_thresholds thr(pf, args.filename, args.rle);
+  unsigned outputs = pfp_thresholds::THRESHOLDS | pfp_thresholds::SA | pfp_thresholds::BWT;
+  if (args.lcp)
+    outputs |= pfp_thresholds::LCP;
+
+  // The runs of the BWT go straight to the index, instead of the files
+  std::unique_ptr<ms_pointers<>::builder> index;
+  pfp_thresholds::run_consumer_t run_consumer = nullptr;
+  if (args.index)
+  {
+    outputs = pfp_thresholds::RUNS | (outputs & pfp_thresholds::LCP);
+    index.reset(new ms_pointers<>::builder(pf.n - pf.w + 1));
+    run_consumer = [&](const pfp_thresholds::bwt_run_t &run) {
+      index->push(run.head, run.length, run.ssa, run.esa, run.threshold);
+    };
+  }
+
+  pfp_thresholds thr(pf, args.filename, args.rle, args.th, outputs, args.checkpoint, run_consumer);
+
+  if (args.index)
+  {
+    verbose("Building the matching statistics index");
+    ms_pointers<> ms(*index, args.th);
+    index.reset();
+
+    std::string outfile = args.filename + ms.filesuffix();
+    std::ofstream out(outfile, std::ios::binary);
+    if (!out)
+      error("open() file " + outfile + " failed");
+    ms.serialize_mapped(out);
+    verbose("Index stored in ", outfile);
+  }
 
   // Building the sampled LCP array of T in corrispondence of the beginning of each phrase.
   // verbose("Building the thresholds - sampled LCP");
@@ -85,7 +143,6 @@ int main(int argc, char* const argv[]) {
   // verbose("Building the thresholds - min_s and pos_s");
 
   
-  // pfp_lcp lcp(pf);
 
   
   // verbose("Memory peak: ", malloc_count_peak());